@@ -0,0 +1,16 @@
+#include "testApp.h"
+#include "ofAppNoWindow.h"
+
+//--------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+	testApp *app = new testApp();
+
+	// key=value overrides, e.g. objects=50 vertices=100000 frames=120 threads=4
+	for (int i = 1; i < argc; i++)
+		app->settings.parse(argv[i]);
+
+	ofAppNoWindow window; // headless, no GL context
+	ofSetupOpenGL(&window, 1024, 768, OF_WINDOW);
+	ofRunApp(app); // start the app
+}
@@ -0,0 +1,648 @@
+#include "testApp.h"
+
+using namespace Alembic::AbcGeom;
+
+#pragma mark - settings
+
+BenchmarkSettings::BenchmarkSettings()
+: num_objects(20)
+, num_vertices(10000)
+, topology_variance(0.1)
+, num_curves_objects(2)
+, num_curves(100)
+, curve_vertices(100)
+, num_points_objects(2)
+, num_points(10000)
+, num_frames(60)
+, fps(30)
+, num_threads(4)
+, queue_size(8)
+, path("benchmark.abc")
+, output("benchmark.json")
+{
+}
+
+void BenchmarkSettings::parse(const string& arg)
+{
+	vector<string> kv = ofSplitString(arg, "=");
+	if (kv.size() != 2)
+	{
+		ofLogError("benchmark") << "expected key=value: " << arg;
+		return;
+	}
+
+	const string &k = kv[0];
+	const string &v = kv[1];
+
+	if (k == "objects") num_objects = ofToInt(v);
+	else if (k == "vertices") num_vertices = ofToInt(v);
+	else if (k == "variance") topology_variance = ofToFloat(v);
+	else if (k == "curves_objects") num_curves_objects = ofToInt(v);
+	else if (k == "curves") num_curves = ofToInt(v);
+	else if (k == "curve_vertices") curve_vertices = ofToInt(v);
+	else if (k == "points_objects") num_points_objects = ofToInt(v);
+	else if (k == "points") num_points = ofToInt(v);
+	else if (k == "frames") num_frames = ofToInt(v);
+	else if (k == "fps") fps = ofToFloat(v);
+	else if (k == "threads") num_threads = ofToInt(v);
+	else if (k == "queue") queue_size = ofToInt(v);
+	else if (k == "path") path = v;
+	else if (k == "output") output = v;
+	else if (k == "trace") trace = v;
+	else ofLogError("benchmark") << "unknown setting: " << k;
+}
+
+string BenchmarkSettings::toJson() const
+{
+	ostringstream o;
+	o << "{"
+	<< "\"objects\": " << num_objects
+	<< ", \"vertices\": " << num_vertices
+	<< ", \"variance\": " << topology_variance
+	<< ", \"curves_objects\": " << num_curves_objects
+	<< ", \"curves\": " << num_curves
+	<< ", \"curve_vertices\": " << curve_vertices
+	<< ", \"points_objects\": " << num_points_objects
+	<< ", \"points\": " << num_points
+	<< ", \"frames\": " << num_frames
+	<< ", \"fps\": " << fps
+	<< ", \"threads\": " << num_threads
+	<< ", \"queue\": " << queue_size
+	<< "}";
+	return o.str();
+}
+
+#pragma mark - timing
+
+double BenchmarkTiming::total() const
+{
+	double t = 0;
+	for (int i = 0; i < samples.size(); i++)
+		t += samples[i];
+	return t;
+}
+
+string BenchmarkTiming::toJson() const
+{
+	ostringstream o;
+
+	if (samples.empty())
+	{
+		o << "{\"count\": 0}";
+		return o.str();
+	}
+
+	vector<double> s = samples;
+	sort(s.begin(), s.end());
+
+	o << "{"
+	<< "\"count\": " << s.size()
+	<< ", \"total_ms\": " << total()
+	<< ", \"mean_ms\": " << total() / s.size()
+	<< ", \"min_ms\": " << s.front()
+	<< ", \"median_ms\": " << s[s.size() / 2]
+	<< ", \"p95_ms\": " << s[MIN(s.size() - 1, s.size() * 95 / 100)]
+	<< ", \"max_ms\": " << s.back()
+	<< "}";
+	return o.str();
+}
+
+#pragma mark - synthetic data
+
+// grid of about `num_vertices` shared vertices, varying meshes gain a column on odd frames
+static void makeMesh(ofMesh &mesh, int num_vertices, int frame, int object, bool varying)
+{
+	int cols = MAX(2, (int)sqrt((float)num_vertices));
+	int rows = MAX(2, num_vertices / cols);
+
+	if (varying) cols += frame % 2;
+
+	mesh.clear();
+	mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+
+	for (int y = 0; y < rows; y++)
+	{
+		for (int x = 0; x < cols; x++)
+		{
+			float z = sin(x * 0.1 + frame * 0.1 + object) * 10;
+			mesh.addVertex(ofVec3f(x, y, z));
+			mesh.addNormal(ofVec3f(0, 0, 1));
+			mesh.addTexCoord(ofVec2f((float)x / cols, (float)y / rows));
+		}
+	}
+
+	for (int y = 0; y < rows - 1; y++)
+	{
+		for (int x = 0; x < cols - 1; x++)
+		{
+			int i = y * cols + x;
+
+			mesh.addIndex(i);
+			mesh.addIndex(i + 1);
+			mesh.addIndex(i + cols);
+
+			mesh.addIndex(i + 1);
+			mesh.addIndex(i + cols + 1);
+			mesh.addIndex(i + cols);
+		}
+	}
+}
+
+static void makeCurves(vector<ofPolyline> &curves, int num_curves, int num_vertices, int frame, int object)
+{
+	curves.resize(num_curves);
+
+	for (int i = 0; i < num_curves; i++)
+	{
+		ofPolyline &poly = curves[i];
+		poly.clear();
+
+		for (int n = 0; n < num_vertices; n++)
+		{
+			float t = n * 0.01 + frame * 0.1 + i + object;
+			poly.addVertex(ofVec3f(sin(t), cos(t), n) * 100);
+		}
+	}
+}
+
+static void makePoints(vector<ofVec3f> &points, int num_points, int frame, int object)
+{
+	points.resize(num_points);
+
+	for (int i = 0; i < num_points; i++)
+	{
+		float t = i * 0.01 + frame * 0.1 + object;
+		points[i] = ofVec3f(sin(t), cos(t), sin(t * 0.5)) * 100;
+	}
+}
+
+static string meshPath(int i) { return "/mesh_" + ofToString(i); }
+static string curvesPath(int i) { return "/curves_" + ofToString(i); }
+static string pointsPath(int i) { return "/points_" + ofToString(i); }
+
+static unsigned long long getFileSize(const string& path)
+{
+	ifstream ifs(ofToDataPath(path).c_str(), ios::in | ios::binary);
+	if (!ifs) return 0;
+
+	ifs.seekg(0, ios::end);
+	return ifs.tellg();
+}
+
+#pragma mark - transform
+
+// the library's own per phase split, in milliseconds
+static string phasesJson(const ofxAlembic::Stats& stats)
+{
+	ostringstream o;
+	o << "{";
+
+	for (int i = 0; i < ofxAlembic::NUM_PHASES; i++)
+	{
+		ofxAlembic::Phase phase = (ofxAlembic::Phase)i;
+
+		if (i) o << ", ";
+		o << "\"" << ofxAlembic::getPhaseName(phase) << "\": " << stats.getTime(phase);
+	}
+
+	o << "}";
+	return o.str();
+}
+
+static const int TRANSFORM_VERTICES = 1000000;
+static const int TRANSFORM_ITERATIONS = 20;
+
+// best of TRANSFORM_ITERATIONS in ms, TRANSFORM_VERTICES is one million
+template <typename F>
+static double timeIt(F &f)
+{
+	double best = 0;
+
+	for (int i = 0; i < TRANSFORM_ITERATIONS; i++)
+	{
+		unsigned long long t = ofGetElapsedTimeMicros();
+		f();
+		t = ofGetElapsedTimeMicros() - t;
+
+		if (i == 0 || t / 1000. < best) best = t / 1000.;
+	}
+
+	return best;
+}
+
+struct ImathTransform
+{
+	const M44f &m;
+	const vector<V3f> &src;
+	vector<V3f> &dst;
+
+	ImathTransform(const M44f &m, const vector<V3f> &src, vector<V3f> &dst) : m(m), src(src), dst(dst) {}
+
+	void operator()()
+	{
+		for (size_t i = 0; i < src.size(); i++)
+			m.multVecMatrix(src[i], dst[i]);
+	}
+};
+
+struct KernelTransform
+{
+	const M44f &m;
+	const vector<V3f> &src;
+	vector<V3f> &dst;
+
+	KernelTransform(const M44f &m, const vector<V3f> &src, vector<V3f> &dst) : m(m), src(src), dst(dst) {}
+
+	void operator()()
+	{
+		ofxAlembic::transformPoints(m.getValue(), src[0].getValue(), dst[0].getValue(), src.size());
+	}
+};
+
+string testApp::benchTransform()
+{
+	vector<V3f> src(TRANSFORM_VERTICES), dst(TRANSFORM_VERTICES);
+
+	for (int i = 0; i < src.size(); i++)
+		src[i] = V3f(ofRandomf(), ofRandomf(), ofRandomf());
+
+	M44f identity;
+
+	M44f affine;
+	affine.setEulerAngles(V3f(0.3, 0.5, 0.7));
+	affine.translate(V3f(1, 2, 3));
+
+	M44f projective = affine;
+	projective[0][3] = 0.1;
+
+	const char *names[] = { "identity", "affine", "projective" };
+	const M44f *mats[] = { &identity, &affine, &projective };
+
+	ostringstream o;
+	o << "{";
+
+	for (int i = 0; i < 3; i++)
+	{
+		ImathTransform imath(*mats[i], src, dst);
+		KernelTransform kernel(*mats[i], src, dst);
+
+		if (i) o << ", ";
+		o << "\"" << names[i] << "\": {"
+		<< "\"multVecMatrix_ms_per_million\": " << timeIt(imath)
+		<< ", \"transformPoints_ms_per_million\": " << timeIt(kernel)
+		<< "}";
+	}
+
+	o << "}";
+	return o.str();
+}
+
+#pragma mark - writer
+
+// only add* and close are timed, generating the data is not
+void testApp::writeArchive(const string& path, bool async, BenchmarkTiming& frames, BenchmarkTiming& close, ofxAlembic::Stats& phases)
+{
+	ofxAlembic::Writer writer;
+
+	if (async)
+		writer.enableAsync(settings.queue_size);
+
+	if (!writer.open(path, settings.fps))
+	{
+		ofLogError("benchmark") << "can't open " << path;
+		return;
+	}
+
+	const int num_varying = settings.num_objects * settings.topology_variance + 0.5;
+
+	ofMesh mesh;
+	vector<ofPolyline> curves;
+	vector<ofVec3f> points;
+
+	for (int f = 0; f < settings.num_frames; f++)
+	{
+		unsigned long long t = 0;
+
+		for (int i = 0; i < settings.num_objects; i++)
+		{
+			makeMesh(mesh, settings.num_vertices, f, i, i < num_varying);
+
+			unsigned long long s = ofGetElapsedTimeMicros();
+			writer.addPolyMesh(meshPath(i), mesh);
+			t += ofGetElapsedTimeMicros() - s;
+		}
+
+		for (int i = 0; i < settings.num_curves_objects; i++)
+		{
+			makeCurves(curves, settings.num_curves, settings.curve_vertices, f, i);
+
+			unsigned long long s = ofGetElapsedTimeMicros();
+			writer.addCurves(curvesPath(i), curves);
+			t += ofGetElapsedTimeMicros() - s;
+		}
+
+		for (int i = 0; i < settings.num_points_objects; i++)
+		{
+			makePoints(points, settings.num_points, f, i);
+
+			unsigned long long s = ofGetElapsedTimeMicros();
+			writer.addPoints(pointsPath(i), points);
+			t += ofGetElapsedTimeMicros() - s;
+		}
+
+		writer.flashFrame();
+		frames.add(t);
+	}
+
+	unsigned long long t = ofGetElapsedTimeMicros();
+
+	ofxAlembic::WriteQueue *queue = writer.getWriteQueue();
+	int num_stalls = queue ? queue->getNumStalls() : 0;
+	float stall_time = queue ? queue->getStallTime() : 0;
+	int max_pending = queue ? queue->getMaxPending() : 0;
+
+	writer.close();
+	close.add(ofGetElapsedTimeMicros() - t);
+
+	phases = writer.getTotalStats();
+
+	if (queue)
+		ofLogNotice("benchmark") << "async writer: " << num_stalls << " stalls, " << stall_time << "s stalled, max " << max_pending << " pending";
+}
+
+string testApp::benchWriter(bool async)
+{
+	BenchmarkTiming frames, close;
+	ofxAlembic::Stats phases;
+
+	string path = async ? "benchmark_async.abc" : settings.path;
+	writeArchive(path, async, frames, close, phases);
+
+	const double total = frames.total() + close.total();
+	const double vertices = (double)settings.num_frames
+		* (settings.num_objects * settings.num_vertices
+		   + settings.num_curves_objects * settings.num_curves * settings.curve_vertices
+		   + settings.num_points_objects * settings.num_points);
+
+	ostringstream o;
+	o << "{"
+	<< "\"add\": " << frames.toJson()
+	<< ", \"close_ms\": " << close.total()
+	<< ", \"total_ms\": " << total
+	<< ", \"vertices_per_second\": " << (total > 0 ? vertices / (total / 1000.) : 0)
+	<< ", \"file_bytes\": " << getFileSize(path)
+	<< ", \"phases_ms\": " << phasesJson(phases)
+	<< "}";
+	return o.str();
+}
+
+// one static mesh written with its face layout every frame, against hashing it and skipping unchanged layouts
+string testApp::benchTopology()
+{
+	ofMesh mesh;
+	makeMesh(mesh, settings.num_vertices, 0, 0, false);
+	const ofxAlembic::PolyMesh polymesh(mesh);
+
+	BenchmarkTiming always, digest, skip;
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		OArchive archive(Alembic::AbcCoreHDF5::WriteArchive(), ofToDataPath("benchmark_topology.abc"));
+		OPolyMesh object(archive.getTop(), "mesh");
+		OPolyMeshSchema &schema = object.getSchema();
+
+		Alembic::Util::uint64_t last = 0;
+
+		for (int f = 0; f < settings.num_frames; f++)
+		{
+			unsigned long long t = ofGetElapsedTimeMicros();
+
+			if (pass == 0)
+			{
+				polymesh.get(schema, true);
+				always.add(ofGetElapsedTimeMicros() - t);
+				continue;
+			}
+
+			const Alembic::Util::uint64_t d = polymesh.getTopologyDigest();
+			digest.add(ofGetElapsedTimeMicros() - t);
+
+			polymesh.get(schema, f == 0 || d != last);
+			skip.add(ofGetElapsedTimeMicros() - t);
+			last = d;
+		}
+	}
+
+	ostringstream o;
+	o << "{"
+	<< "\"indices\": " << mesh.getNumIndices()
+	<< ", \"with_topology\": " << always.toJson()
+	<< ", \"digest\": " << digest.toJson()
+	<< ", \"digest_and_skip\": " << skip.toJson()
+	<< "}";
+	return o.str();
+}
+
+#pragma mark - reader
+
+string testApp::benchReader()
+{
+	ofxAlembic::Reader reader;
+
+	BenchmarkTiming open;
+
+	unsigned long long t = ofGetElapsedTimeMicros();
+	if (!reader.open(settings.path))
+	{
+		ofLogError("benchmark") << "can't open " << settings.path;
+		failed = true;
+		return "{}";
+	}
+	open.add(ofGetElapsedTimeMicros() - t);
+
+	BenchmarkTiming set_time, get_copy, set_time_steady, set_time_threaded;
+
+	ofMesh mesh;
+	vector<ofPolyline> curves;
+	vector<ofVec3f> points;
+
+	// first pass decodes every frame once, get() copies each object out
+	for (int f = 0; f < settings.num_frames; f++)
+	{
+		t = ofGetElapsedTimeMicros();
+		reader.setTime(f / settings.fps);
+		set_time.add(ofGetElapsedTimeMicros() - t);
+
+		t = ofGetElapsedTimeMicros();
+
+		for (int i = 0; i < settings.num_objects; i++)
+			reader.get(meshPath(i), mesh);
+
+		for (int i = 0; i < settings.num_curves_objects; i++)
+			reader.get(curvesPath(i), curves);
+
+		for (int i = 0; i < settings.num_points_objects; i++)
+			reader.get(pointsPath(i), points);
+
+		get_copy.add(ofGetElapsedTimeMicros() - t);
+	}
+
+	const ofxAlembic::Stats phases = reader.getTotalStats();
+
+	// warmed up, this pass should not grow any decode buffer
+	ofxAlembic::resetNumAllocations();
+
+	for (int f = 0; f < settings.num_frames; f++)
+	{
+		t = ofGetElapsedTimeMicros();
+		reader.setTime(f / settings.fps);
+		set_time_steady.add(ofGetElapsedTimeMicros() - t);
+	}
+
+	const size_t steady_allocations = ofxAlembic::getNumAllocations();
+
+	if (settings.num_threads > 0)
+	{
+		reader.setNumThreads(settings.num_threads);
+
+		for (int f = 0; f < settings.num_frames; f++)
+		{
+			t = ofGetElapsedTimeMicros();
+			reader.setTime(f / settings.fps);
+			set_time_threaded.add(ofGetElapsedTimeMicros() - t);
+		}
+	}
+
+	reader.close();
+
+	ostringstream o;
+	o << "{"
+	<< "\"format\": \"" << ofxAlembic::getFormatName(ofxAlembic::detectFormat(ofToDataPath(settings.path))) << "\""
+	<< ", \"open_ms\": " << open.total()
+	<< ", \"set_time\": " << set_time.toJson()
+	<< ", \"get\": " << get_copy.toJson()
+	<< ", \"phases_ms\": " << phasesJson(phases)
+	<< ", \"set_time_steady\": " << set_time_steady.toJson()
+	<< ", \"steady_allocations\": " << steady_allocations
+	<< ", \"set_time_threaded\": " << set_time_threaded.toJson()
+	<< "}";
+	return o.str();
+}
+
+#pragma mark - seek
+
+static const int SEEK_COUNT = 10;
+static const int SEEK_PREFETCH_FRAMES = 4;
+static const unsigned long long SEEK_TIMEOUT_MICROS = 5000000; // a frame that never arrives fails the run
+
+// every mesh below one top level xform, the layout most DCC exports have
+static void writeSingleRootArchive(const string& path, const BenchmarkSettings& settings)
+{
+	OArchive archive(Alembic::AbcCoreHDF5::WriteArchive(), ofToDataPath(path));
+	const Alembic::Util::uint32_t tsidx = archive.addTimeSampling(TimeSampling(1.0 / settings.fps, 0));
+
+	OXform root(archive.getTop(), "root");
+	root.getSchema().set(XformSample());
+
+	vector<OPolyMesh> meshes;
+	for (int i = 0; i < settings.num_objects; i++)
+		meshes.push_back(OPolyMesh(root, "mesh_" + ofToString(i), tsidx));
+
+	ofMesh mesh;
+
+	for (int f = 0; f < settings.num_frames; f++)
+	{
+		for (int i = 0; i < meshes.size(); i++)
+		{
+			makeMesh(mesh, settings.num_vertices, f, i, false);
+			ofxAlembic::PolyMesh(mesh).get(meshes[i].getSchema());
+		}
+	}
+}
+
+// time from a seek until the prefetched frame is ready. a decode of the frame left behind has to
+// cancel inside the single root, otherwise every seek waits for it first
+string testApp::benchSeek()
+{
+	const string path = "benchmark_single_root.abc";
+	writeSingleRootArchive(path, settings);
+
+	ofxAlembic::Reader reader;
+
+	if (!reader.open(path))
+	{
+		ofLogError("benchmark") << "can't open " << path;
+		failed = true;
+		return "{}";
+	}
+
+	reader.enablePrefetch(SEEK_PREFETCH_FRAMES, settings.fps);
+
+	BenchmarkTiming seek;
+	int timed_out_frame = -1;
+
+	for (int k = 0; k < SEEK_COUNT && timed_out_frame < 0; k++)
+	{
+		// jumps further than the prefetch window
+		const int frame = (k * 37) % settings.num_frames;
+
+		unsigned long long t = ofGetElapsedTimeMicros();
+
+		while (!reader.setTime(frame / settings.fps))
+		{
+			if (ofGetElapsedTimeMicros() - t > SEEK_TIMEOUT_MICROS)
+			{
+				ofLogError("benchmark") << "seek to frame " << frame << " timed out";
+				timed_out_frame = frame;
+				failed = true;
+				break;
+			}
+
+			ofSleepMillis(1);
+		}
+
+		if (timed_out_frame < 0)
+			seek.add(ofGetElapsedTimeMicros() - t);
+	}
+
+	ofxAlembic::Prefetcher *prefetcher = reader.getPrefetcher();
+
+	ostringstream o;
+	o << "{"
+	<< "\"failed\": " << (timed_out_frame < 0 ? "false" : "true")
+	<< ", \"timed_out_frame\": " << timed_out_frame
+	<< ", \"seek\": " << seek.toJson()
+	<< ", \"hits\": " << prefetcher->getNumHits()
+	<< ", \"misses\": " << prefetcher->getNumMisses()
+	<< "}";
+	return o.str();
+}
+
+//--------------------------------------------------------------
+void testApp::setup()
+{
+	if (!settings.trace.empty())
+		ofxAlembic::enableTrace(1 << 20);
+
+	ostringstream o;
+	o << "{" << endl
+	<< "\"settings\": " << settings.toJson() << "," << endl
+	<< "\"transform\": " << benchTransform() << "," << endl
+	<< "\"writer\": " << benchWriter(false) << "," << endl
+	<< "\"writer_async\": " << benchWriter(true) << "," << endl
+	<< "\"topology\": " << benchTopology() << "," << endl
+	<< "\"reader\": " << benchReader() << "," << endl
+	<< "\"seek_single_root\": " << benchSeek() << endl
+	<< "}" << endl;
+
+	cout << o.str();
+
+	ofstream ofs(ofToDataPath(settings.output).c_str());
+	ofs << o.str();
+
+	if (!settings.trace.empty())
+		ofxAlembic::dumpTrace(settings.trace);
+
+	// CI picks failures up from the exit code
+	ofExit(failed ? 1 : 0);
+}
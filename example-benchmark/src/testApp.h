@@ -0,0 +1,68 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include "ofxAlembic.h"
+
+// size of the synthetic archive
+
+struct BenchmarkSettings
+{
+	int num_objects; // polymeshes
+	int num_vertices; // per polymesh
+	float topology_variance; // fraction of polymeshes whose face layout changes every frame
+
+	int num_curves_objects;
+	int num_curves; // per curves object
+	int curve_vertices;
+
+	int num_points_objects;
+	int num_points; // per points object
+
+	int num_frames;
+	float fps;
+
+	int num_threads; // reader worker threads for the threaded pass
+	int queue_size; // async writer queue
+
+	string path;
+	string output;
+	string trace; // Chrome trace of the whole run, off when empty
+
+	BenchmarkSettings();
+
+	void parse(const string& arg);
+	string toJson() const;
+};
+
+// collects samples in milliseconds
+
+struct BenchmarkTiming
+{
+	vector<double> samples;
+
+	void add(unsigned long long micros) { samples.push_back(micros / 1000.); }
+
+	double total() const;
+	string toJson() const;
+};
+
+class testApp : public ofBaseApp
+{
+public:
+
+	BenchmarkSettings settings;
+	bool failed; // a benchmark could not finish, the app exits with 1
+
+	testApp() : failed(false) {}
+
+	void setup();
+
+	string benchTransform();
+	string benchWriter(bool async);
+	string benchTopology();
+	string benchReader();
+	string benchSeek();
+
+	void writeArchive(const string& path, bool async, BenchmarkTiming& frames, BenchmarkTiming& close, ofxAlembic::Stats& phases);
+};
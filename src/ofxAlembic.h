@@ -3,4 +3,9 @@
 #include "ofxAlembicType.h"
 #include "ofxAlembicUtil.h"
 #include "ofxAlembicReader.h"
-#include "ofxAlembicWriter.h"
\ No newline at end of file
+#include "ofxAlembicWriter.h"
+#include "ofxAlembicPrefetcher.h"
+#include "ofxAlembicTaskPool.h"
+#include "ofxAlembicWriteQueue.h"
+#include "ofxAlembicStats.h"
+#include "ofxAlembicTrace.h"
\ No newline at end of file
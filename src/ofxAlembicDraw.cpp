@@ -0,0 +1,127 @@
+#include "ofxAlembicReader.h"
+
+// everything touching OpenGL lives in here, define OFX_ALEMBIC_NO_GL to build the addon without it
+
+#ifndef OFX_ALEMBIC_NO_GL
+
+using namespace ofxAlembic;
+using namespace Alembic::AbcGeom;
+
+#pragma mark - Points
+
+void Points::draw()
+{
+	if (positions.empty()) return;
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, positions[0].getPtr());
+	glDrawArrays(GL_POINTS, 0, positions.size());
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+#pragma mark - PolyMesh
+
+void PolyMesh::draw()
+{
+	//CW: change this
+	/*
+	shader.begin();
+	ofSetColor();
+	*/
+	//ofSetColor( 255, 0, 255);
+
+	if( ofGetFill() == OF_OUTLINE ){
+		mesh.drawWireframe();
+	}else{
+		mesh.draw();
+	}
+}
+
+void PolyMesh::drawTextured( ofImage *tex ){
+	tex->getTextureReference().bind();
+	if( ofGetFill() == OF_OUTLINE ){
+		mesh.drawWireframe();
+	}else{
+		mesh.draw();
+	}
+	tex->getTextureReference().unbind();
+}
+
+#pragma mark - Curves
+
+void Curves::draw()
+{
+	if (positions.empty() || counts.empty()) return;
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, positions[0].getPtr());
+
+#ifndef TARGET_OPENGLES
+	// every curve in a single call
+	glMultiDrawArrays(GL_LINE_STRIP, (const GLint*)&offsets[0], (const GLsizei*)&counts[0], counts.size());
+#else
+	// GLES has no glMultiDrawArrays
+	for (size_t i = 0; i < counts.size(); i++)
+		glDrawArrays(GL_LINE_STRIP, offsets[i], counts[i]);
+#endif
+
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+#pragma mark - Reader
+
+void ofxAlembic::Reader::draw()
+{
+	if (!m_root) return;
+
+	m_root->draw();
+}
+
+#pragma mark - IGeom
+
+void IGeom::draw()
+{
+	const M44f &m = evaluate();
+
+	if (m_baked)
+	{
+		drawInternal();
+	}
+	else
+	{
+		ofPushMatrix();
+		ofMultMatrix(toOf(m));
+		drawInternal();
+		ofPopMatrix();
+	}
+
+	for (int i = 0; i < m_children.size(); i++)
+	{
+		ofPtr<IGeom> c = m_children[i];
+		c->draw();
+	}
+}
+
+void IGeom::drawTextured( ofImage *tex ){
+	const M44f &m = evaluate();
+
+	if (m_baked)
+	{
+		drawInternalTextured( tex );
+	}
+	else
+	{
+		ofPushMatrix();
+		ofMultMatrix(toOf(m));
+		drawInternalTextured( tex );
+		ofPopMatrix();
+	}
+
+	for (int i = 0; i < m_children.size(); i++)
+	{
+		ofPtr<IGeom> c = m_children[i];
+		c->drawTextured( tex );
+	}
+}
+
+#endif
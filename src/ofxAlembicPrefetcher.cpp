@@ -0,0 +1,277 @@
+#include "ofxAlembicPrefetcher.h"
+
+#include "ofxAlembicReader.h"
+#include "ofxAlembicTrace.h"
+
+using namespace ofxAlembic;
+using namespace Alembic::AbcGeom;
+
+Prefetcher::Prefetcher() : fps(30), min_frame(0), max_frame(0), playhead(0), direction(1), current_frame(-1), num_hits(0), num_misses(0)
+{
+}
+
+Prefetcher::~Prefetcher()
+{
+	clear();
+}
+
+void Prefetcher::setup(IArchive archive, const vector<IGeom*>& objects, int num_frames, float fps_)
+{
+	clear();
+
+	if (!archive.valid() || num_frames < 1 || fps_ <= 0) return;
+
+	fps = fps_;
+	slots.resize(num_frames);
+
+	for (int i = 0; i < slots.size(); i++)
+	{
+		Slot &slot = slots[i];
+
+		{
+			ArchiveLock lock;
+			slot.root = ofPtr<IGeom>(new IGeom(archive.getTop()));
+		}
+
+		map<string, IGeom*> object_map;
+		IGeom::visit_geoms(slot.root, object_map);
+
+		map<string, IGeom*>::iterator it = object_map.begin();
+		while (it != object_map.end())
+		{
+			slot.objects.push_back(it->second);
+			it++;
+		}
+
+		for (int n = 0; n < slot.objects.size() && n < objects.size(); n++)
+			slot.objects[n]->copySettings(*objects[n]);
+
+		// xforms are not among `objects`, they interpolate along with the geometry
+		if (!objects.empty())
+			slot.root->setInterpolated(objects[0]->isInterpolated());
+	}
+
+	min_frame = floor(slots[0].root->m_minTime * fps + 0.5);
+	max_frame = floor(slots[0].root->m_maxTime * fps + 0.5);
+
+	playhead = min_frame;
+	direction = 1;
+	current_frame = -1;
+
+	num_hits = 0;
+	num_misses = 0;
+
+	startThread(true, false);
+}
+
+void Prefetcher::clear()
+{
+	if (isThreadRunning())
+	{
+		lock();
+		stopThread();
+		condition.broadcast();
+		unlock();
+
+		waitForThread(false);
+	}
+
+	ArchiveLock lock;
+	slots.clear();
+}
+
+bool Prefetcher::fetch(double time, vector<IGeom*>& objects)
+{
+	if (slots.empty()) return false;
+
+	int frame = floor(time * fps + 0.5);
+	frame = ofClamp(frame, min_frame, max_frame);
+
+	lock();
+
+	if (frame == current_frame)
+	{
+		unlock();
+		return true;
+	}
+
+	if (frame > playhead) direction = 1;
+	else if (frame < playhead) direction = -1;
+
+	playhead = frame;
+
+	bool hit = false;
+
+	int idx = findSlot(frame);
+	if (idx >= 0 && slots[idx].state == READY
+		&& slots[idx].objects.size() == objects.size())
+	{
+		Slot &slot = slots[idx];
+
+		for (int i = 0; i < objects.size(); i++)
+		{
+			// fold the outgoing frame into the totals before the slot takes it
+			objects[i]->m_totalStats.add(objects[i]->m_stats);
+			objects[i]->m_stats.clear();
+			objects[i]->swapState(*slot.objects[i]);
+		}
+
+		// the slot now holds the previous state, give it back to the worker
+		slot.state = EMPTY;
+		slot.frame = -1;
+
+		current_frame = frame;
+		hit = true;
+	}
+
+	if (hit) num_hits++;
+	else num_misses++;
+
+	condition.signal();
+	unlock();
+
+	return hit;
+}
+
+MemoryUsage Prefetcher::getMemoryUsage()
+{
+	MemoryUsage usage;
+
+	lock();
+
+	for (int i = 0; i < slots.size(); i++)
+	{
+		if (slots[i].state == DECODING) continue;
+
+		for (int n = 0; n < slots[i].objects.size(); n++)
+			usage.add(slots[i].objects[n]->getMemoryUsage());
+	}
+
+	unlock();
+
+	return usage;
+}
+
+bool Prefetcher::isWanted(int frame) const
+{
+	if (frame == current_frame) return false;
+
+	int d = (frame - playhead) * direction;
+	return d >= 0 && d < slots.size();
+}
+
+int Prefetcher::findSlot(int frame) const
+{
+	for (int i = 0; i < slots.size(); i++)
+	{
+		if (slots[i].state != EMPTY && slots[i].frame == frame)
+			return i;
+	}
+	return -1;
+}
+
+bool Prefetcher::nextRequest(int &slot_index, int &frame)
+{
+	for (int k = 0; k < slots.size(); k++)
+	{
+		int f = playhead + direction * k;
+
+		if (f < min_frame || f > max_frame) break;
+		if (f == current_frame) continue;
+		if (findSlot(f) >= 0) continue;
+
+		int idx = -1;
+
+		for (int i = 0; i < slots.size() && idx < 0; i++)
+		{
+			if (slots[i].state == EMPTY)
+				idx = i;
+		}
+
+		// recycle a ready frame the playhead has moved away from
+		for (int i = 0; i < slots.size() && idx < 0; i++)
+		{
+			if (slots[i].state == READY && !isWanted(slots[i].frame))
+				idx = i;
+		}
+
+		if (idx < 0) return false;
+
+		slots[idx].state = DECODING;
+		slots[idx].frame = f;
+
+		slot_index = idx;
+		frame = f;
+		return true;
+	}
+
+	return false;
+}
+
+// cancels a decode when a seek moved the playhead away from its frame
+
+struct FrameCancel : public UpdateCancel
+{
+	Prefetcher *prefetcher;
+	int frame;
+
+	FrameCancel(Prefetcher *prefetcher, int frame) : prefetcher(prefetcher), frame(frame) {}
+
+	bool isCancelled()
+	{
+		return !prefetcher->isStillWanted(frame);
+	}
+};
+
+bool Prefetcher::isStillWanted(int frame)
+{
+	lock();
+	bool wanted = isWanted(frame);
+	unlock();
+	return wanted;
+}
+
+bool Prefetcher::decode(Slot &slot, int frame)
+{
+	double time = frame / fps;
+
+	OFX_ALEMBIC_TRACE("Prefetcher::decode", ofToString(frame));
+
+	// checked before every object, archives with a single top level xform cancel as soon as the others
+	FrameCancel cancel(this, frame);
+
+	Imath::M44f m;
+	m.makeIdentity();
+	return slot.root->updateWithTime(time, m, &cancel);
+}
+
+void Prefetcher::threadedFunction()
+{
+	while (isThreadRunning())
+	{
+		int slot_index = -1;
+		int frame = -1;
+
+		lock();
+		while (isThreadRunning() && !nextRequest(slot_index, frame))
+			condition.wait(mutex);
+		unlock();
+
+		if (slot_index < 0) break;
+
+		Slot &slot = slots[slot_index];
+		bool done = decode(slot, frame);
+
+		lock();
+		if (done)
+		{
+			slot.state = READY;
+		}
+		else
+		{
+			slot.state = EMPTY;
+			slot.frame = -1;
+		}
+		unlock();
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include "Poco/Condition.h"
+
+#include <Alembic/AbcGeom/All.h>
+#include <Alembic/AbcCoreHDF5/All.h>
+
+#include "ofxAlembicType.h"
+
+namespace ofxAlembic
+{
+class IGeom;
+class Prefetcher;
+}
+
+// decodes frames ahead of the playhead on a worker thread.
+// every slot owns its own IGeom tree, a hit swaps the decoded state into the reader's tree.
+
+class ofxAlembic::Prefetcher : public ofThread
+{
+public:
+
+	Prefetcher();
+	~Prefetcher();
+
+	// `objects` are the reader's objects, their settings are copied to every slot
+	void setup(Alembic::AbcGeom::IArchive archive, const vector<IGeom*>& objects, int num_frames, float fps);
+	void clear();
+
+	// swap the prebuilt state for `time` into `objects`, returns false on a miss
+	bool fetch(double time, vector<IGeom*>& objects);
+
+	inline int getNumFrames() const { return slots.size(); }
+	inline float getFps() const { return fps; }
+
+	// false once the playhead moved so far that `frame` is not prefetched anymore
+	bool isStillWanted(int frame);
+
+	inline int getNumHits() const { return num_hits; }
+	inline int getNumMisses() const { return num_misses; }
+
+	// frames that are ready or free, slots being decoded are skipped
+	MemoryUsage getMemoryUsage();
+
+protected:
+
+	enum SlotState
+	{
+		EMPTY = 0,
+		DECODING,
+		READY
+	};
+
+	struct Slot
+	{
+		ofPtr<IGeom> root;
+		vector<IGeom*> objects;
+		int frame;
+		SlotState state;
+
+		Slot() : frame(-1), state(EMPTY) {}
+	};
+
+	vector<Slot> slots;
+	Poco::Condition condition;
+
+	float fps;
+	int min_frame;
+	int max_frame;
+
+	int playhead;
+	int direction;
+	int current_frame;
+
+	int num_hits;
+	int num_misses;
+
+	void threadedFunction();
+
+	bool isWanted(int frame) const;
+	int findSlot(int frame) const;
+	bool nextRequest(int &slot_index, int &frame);
+	bool decode(Slot &slot, int frame);
+};
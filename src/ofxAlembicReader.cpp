@@ -1,28 +1,23 @@
 #include "ofxAlembicReader.h"
+#include "ofxAlembicPrefetcher.h"
+#include "ofxAlembicTrace.h"
 
 using namespace ofxAlembic;
 using namespace Alembic::AbcGeom;
 
+static const M44f identity_matrix;
+
 #pragma mark - IXform
 
 class ofxAlembic::IXform : public ofxAlembic::IGeom
 {
 public:
 
-	IXform(Alembic::AbcGeom::IXform object) : ofxAlembic::IGeom(object), m_xform(object)
+	IXform(Alembic::AbcGeom::IXform object) : ofxAlembic::IGeom(object), m_xform(object), m_lastRead(0)
 	{
-		TimeSamplingPtr iTsmp = m_xform.getSchema().getTimeSampling();
-		if (!m_xform.getSchema().isConstant())
-		{
-			size_t numSamps =  m_xform.getSchema().getNumSamples();
-			if (numSamps > 0)
-			{
-				chrono_t minTime = iTsmp->getSampleTime(0);
-				m_minTime = std::min(m_minTime, minTime);
-				chrono_t maxTime = iTsmp->getSampleTime(numSamps - 1);
-				m_maxTime = std::max(m_maxTime, maxTime);
-			}
-		}
+		m_readIndex[0] = m_readIndex[1] = -1;
+
+		setSampling(m_xform.getSchema());
 	}
 
 	~IXform()
@@ -36,99 +31,294 @@ public:
 protected:
 
 	Alembic::AbcGeom::IXform m_xform;
+	M44f m_matrix;
 
+	// the last two samples read, enough to blend between them without reading again
+	index_t m_readIndex[2];
+	M44d m_readMatrix[2];
+	int m_lastRead;
+
+	const M44d& readMatrix(index_t index);
 	void updateWithTimeInternal(double time, Imath::M44f& transform);
 };
 
+const M44d& ofxAlembic::IXform::readMatrix(index_t index)
+{
+	for (int i = 0; i < 2; i++)
+	{
+		if (m_readIndex[i] != index) continue;
+
+		m_lastRead = i;
+		return m_readMatrix[i];
+	}
+
+	// replace the one not used last, it is not part of the current pair
+	const int slot = 1 - m_lastRead;
+
+	{
+		ArchiveLock lock;
+		m_readMatrix[slot] = m_xform.getSchema().getValue(ISampleSelector(index)).getMatrix();
+	}
+
+	m_readIndex[slot] = index;
+	m_lastRead = slot;
+	return m_readMatrix[slot];
+}
+
 void ofxAlembic::IXform::updateWithTimeInternal(double time, Imath::M44f& transform)
 {
-	ISampleSelector ss(time, ISampleSelector::kNearIndex);
+	IXformSchema &schema = m_xform.getSchema();
+
+	index_t index, next;
+	float alpha = 0;
+
+	if (!getSampleBracket(time, index, next, alpha))
+		index = getSampleIndex(time);
+
+	if (index != m_sampleIndex || alpha != m_sampleAlpha)
+	{
+		M44d m = readMatrix(index);
 
-	M44f mat;
-	M44d m = m_xform.getSchema().getValue(ss).getMatrix();
-	double *src = m.getValue();
-	float *dst = mat.getValue();
+		if (alpha > 0)
+			m = interpolateMatrix(m, readMatrix(next), alpha);
 
-	for (int i = 0; i < 16; i++)
-		dst[i] = src[i];
+		double *src = m.getValue();
+		float *dst = m_matrix.getValue();
 
-	transform = mat * transform;
+		for (int i = 0; i < 16; i++)
+			dst[i] = src[i];
+
+		m_sampleIndex = index;
+		m_sampleAlpha = alpha;
+	}
+
+	transform = m_matrix * transform;
 }
 
 #pragma mark - IPoints
 
 ofxAlembic::IPoints::IPoints(Alembic::AbcGeom::IPoints object) : ofxAlembic::IGeom(object), m_points(object)
 {
-	TimeSamplingPtr iTsmp = m_points.getSchema().getTimeSampling();
-	if (!m_points.getSchema().isConstant())
+	setSampling(m_points.getSchema());
+
+	type = POINTS;
+}
+
+void ofxAlembic::IPoints::updateWithTimeInternal(double time, Imath::M44f& transform)
+{
+	IPointsSchema &schema = m_points.getSchema();
+	const M44f &m = getBakeTransform(transform);
+
+	index_t index, next;
+	float alpha;
+
+	if (getSampleBracket(time, index, next, alpha))
 	{
-		size_t numSamps =  m_points.getSchema().getNumSamples();
-		if (numSamps > 0)
+		if (isSampleCurrent(index, m, alpha)) return;
+
+		// pairs with a different point count or order are known after the first read, they step to the nearer sample
+		if (!m_blend.isCached(index, next) || m_blend.matches)
 		{
-			chrono_t minTime = iTsmp->getSampleTime(0);
-			m_minTime = std::min(m_minTime, minTime);
-			chrono_t maxTime = iTsmp->getSampleTime(numSamps - 1);
-			m_maxTime = std::max(m_maxTime, maxTime);
+			if (!isSampleDecoded(index, m))
+			{
+				points.set(schema, ISampleSelector(index), m, &m_view, &m_stats, m_attributes);
+				setSampleCurrent(index, m);
+			}
+
+			if (!m_blend.isCached(index, next))
+			{
+				Points::readBlend(schema, ISampleSelector(next), m_view, m_blend, &m_stats);
+				m_blend.floor = index;
+				m_blend.ceil = next;
+			}
+
+			if (m_blend.matches)
+			{
+				points.blend(m_view, m_blend, alpha, m, &m_stats);
+				setSampleCurrent(index, m, alpha);
+				return;
+			}
 		}
 	}
 
-	type = POINTS;
+	index = getSampleIndex(time);
+	if (isSampleCurrent(index, m)) return;
+
+	points.set(schema, ISampleSelector(index), m, &m_view, &m_stats, m_attributes);
+	setSampleCurrent(index, m);
 }
 
-void ofxAlembic::IPoints::updateWithTimeInternal(double time, Imath::M44f& transform)
+MemoryUsage ofxAlembic::IPoints::getMemoryUsage() const
 {
-	points.set(m_points.getSchema(), time, transform);
+	MemoryUsage usage;
+	usage.decoded = points.getMemoryUsage();
+	usage.cache = m_view.getMemoryUsage() + m_blend.getMemoryUsage();
+	return usage;
 }
 
 #pragma mark - ICurves
 
 ofxAlembic::ICurves::ICurves(Alembic::AbcGeom::ICurves object) : ofxAlembic::IGeom(object), m_curves(object)
 {
+	setSampling(m_curves.getSchema());
+
+	type = CURVES;
+}
 
-	TimeSamplingPtr iTsmp = m_curves.getSchema().getTimeSampling();
-	if (!object.getSchema().isConstant())
+void ofxAlembic::ICurves::updateWithTimeInternal(double time, Imath::M44f& transform)
+{
+	ICurvesSchema &schema = m_curves.getSchema();
+	const M44f &m = getBakeTransform(transform);
+
+	index_t index, next;
+	float alpha;
+
+	if (getSampleBracket(time, index, next, alpha))
 	{
-		size_t numSamps = object.getSchema().getNumSamples();
-		if (numSamps > 0)
+		if (isSampleCurrent(index, m, alpha)) return;
+
+		if (!m_blend.isCached(index, next) || m_blend.matches)
 		{
-			chrono_t minTime = iTsmp->getSampleTime(0);
-			m_minTime = std::min(m_minTime, minTime);
-			chrono_t maxTime = iTsmp->getSampleTime(numSamps - 1);
-			m_maxTime = std::max(m_maxTime, maxTime);
+			if (!isSampleDecoded(index, m))
+			{
+				curves.set(schema, ISampleSelector(index), m, &m_view, &m_stats);
+				setSampleCurrent(index, m);
+			}
+
+			if (!m_blend.isCached(index, next))
+			{
+				Curves::readBlend(schema, ISampleSelector(next), m_view, m_blend, &m_stats);
+				m_blend.floor = index;
+				m_blend.ceil = next;
+			}
+
+			if (m_blend.matches)
+			{
+				curves.blend(m_view, m_blend, alpha, m, &m_stats);
+				setSampleCurrent(index, m, alpha);
+				return;
+			}
 		}
 	}
 
-	type = CURVES;
+	index = getSampleIndex(time);
+	if (isSampleCurrent(index, m)) return;
+
+	curves.set(schema, ISampleSelector(index), m, &m_view, &m_stats);
+	setSampleCurrent(index, m);
 }
 
-void ofxAlembic::ICurves::updateWithTimeInternal(double time, Imath::M44f& transform)
+MemoryUsage ofxAlembic::ICurves::getMemoryUsage() const
 {
-	curves.set(m_curves.getSchema(), time, transform);
+	MemoryUsage usage;
+	usage.decoded = curves.getMemoryUsage();
+	usage.cache = m_view.getMemoryUsage() + m_blend.getMemoryUsage();
+	return usage;
 }
 
 #pragma mark - IPolyMesh
 
-ofxAlembic::IPolyMesh::IPolyMesh(Alembic::AbcGeom::IPolyMesh object) : ofxAlembic::IGeom(object), m_polyMesh(object)
+ofxAlembic::IPolyMesh::IPolyMesh(Alembic::AbcGeom::IPolyMesh object) : ofxAlembic::IGeom(object), m_polyMesh(object), m_heterogenous(false)
 {
-	TimeSamplingPtr iTsmp = m_polyMesh.getSchema().getTimeSampling();
-	if (!m_polyMesh.getSchema().isConstant())
+	setSampling(m_polyMesh.getSchema());
+	m_heterogenous = m_polyMesh.getSchema().getTopologyVariance() == kHeterogenousTopology;
+
+	type = POLYMESH;
+}
+
+void ofxAlembic::IPolyMesh::updateWithTimeInternal(double time, Imath::M44f& transform)
+{
+	IPolyMeshSchema &schema = m_polyMesh.getSchema();
+	const M44f &m = getBakeTransform(transform);
+
+	index_t index, next;
+	float alpha;
+
+	if (getSampleBracket(time, index, next, alpha))
 	{
-		size_t numSamps =  m_polyMesh.getSchema().getNumSamples();
-		if (numSamps > 0)
+		if (isSampleCurrent(index, m, alpha)) return;
+
+		// pairs with a different face layout are known after the first read, they step to the nearer sample
+		if (!m_blend.isCached(index, next) || m_blend.matches)
 		{
-			chrono_t minTime = iTsmp->getSampleTime(0);
-			m_minTime = std::min(m_minTime, minTime);
-			chrono_t maxTime = iTsmp->getSampleTime(numSamps - 1);
-			m_maxTime = std::max(m_maxTime, maxTime);
+			// the earlier sample is decoded as usual, blending only replaces positions and normals
+			if (!isSampleDecoded(index, m))
+			{
+				decode(index, m);
+				setSampleCurrent(index, m);
+			}
+
+			if (!m_blend.isCached(index, next))
+			{
+				PolyMesh::readBlend(schema, ISampleSelector(next), m_view, m_blend, &m_stats, m_attributes);
+				m_blend.floor = index;
+				m_blend.ceil = next;
+			}
+
+			if (m_blend.matches)
+			{
+				polymesh.blend(m_view, m_blend, alpha, m, &m_topology, &m_stats, m_attributes);
+				setSampleCurrent(index, m, alpha);
+				return;
+			}
 		}
 	}
 
-	type = POLYMESH;
+	index = getSampleIndex(time);
+	if (isSampleCurrent(index, m)) return;
+
+	decode(index, m);
+	setSampleCurrent(index, m);
 }
 
-void ofxAlembic::IPolyMesh::updateWithTimeInternal(double time, Imath::M44f& transform)
+void ofxAlembic::IPolyMesh::decode(index_t index, const Imath::M44f& transform)
 {
-	polymesh.set(m_polyMesh.getSchema(), time, transform);
+	IPolyMeshSchema &schema = m_polyMesh.getSchema();
+
+	// triangulate once when the face layout is the same for every sample
+	if (m_heterogenous)
+		m_topology.invalidate();
+
+	polymesh.set(schema, ISampleSelector(index), transform, &m_topology, &m_view, &m_stats, m_attributes);
+}
+
+MemoryUsage ofxAlembic::IPolyMesh::getMemoryUsage() const
+{
+	MemoryUsage usage;
+	usage.decoded = polymesh.getMemoryUsage();
+	usage.scratch = m_topology.getMemoryUsage();
+	usage.cache = m_view.getMemoryUsage() + m_blend.getMemoryUsage();
+	return usage;
+}
+
+void ofxAlembic::IPolyMesh::setIndexed(bool indexed)
+{
+	if (m_topology.indexed == indexed) return;
+
+	m_topology.indexed = indexed;
+	m_topology.invalidate();
+	m_sampleIndex = -1;
+}
+
+void ofxAlembic::IPolyMesh::setNormalMode(NormalMode mode)
+{
+	if (m_topology.normal_mode == mode) return;
+
+	// flat normals weld differently, and the mesh has to lose the old normals
+	m_topology.normal_mode = mode;
+	m_topology.invalidate();
+	m_sampleIndex = -1;
+}
+
+void ofxAlembic::IPolyMesh::setAttributes(unsigned int attributes)
+{
+	if (m_attributes == attributes) return;
+
+	IGeom::setAttributes(attributes);
+
+	// welded vertices split on the attributes that were read
+	if (m_topology.indexed)
+		m_topology.invalidate();
 }
 
 #pragma mark - Reader
@@ -146,13 +336,42 @@ void ofxAlembic::IGeom::visit_geoms(ofPtr<IGeom> &obj, map<string, IGeom*> &obje
 bool ofxAlembic::Reader::open(string path)
 {
 	ofxAlembic::init();
+
+	close();
 	
 	path = ofToDataPath(path);
 
-	m_archive = IArchive(Alembic::AbcCoreHDF5::ReadArchive(), path);
-	if (!m_archive.valid()) return false;
+	Format format = detectFormat(path);
 
-	m_root = ofPtr<IGeom>(new IGeom(m_archive.getTop()));
+	if (!isFormatSupported(format))
+	{
+		ofLogError("ofxAlembic::Reader") << "unsupported archive format (" << getFormatName(format) << "): " << path;
+		return false;
+	}
+
+	retainArchive(format);
+
+	{
+		ArchiveLock lock;
+
+		if (format == FORMAT_HDF5)
+			m_archive = IArchive(Alembic::AbcCoreHDF5::ReadArchive(), path);
+#ifdef OFX_ALEMBIC_OGAWA
+		else if (format == FORMAT_OGAWA)
+			m_archive = IArchive(Alembic::AbcCoreOgawa::ReadArchive(getNumThreads() + 2), path); // main, prefetch and workers
+#endif
+
+		if (m_archive.valid())
+			m_root = ofPtr<IGeom>(new IGeom(m_archive.getTop()));
+	}
+
+	if (!m_archive.valid())
+	{
+		releaseArchive(format);
+		return false;
+	}
+
+	m_format = format;
 
 	{
 		object_arr.clear();
@@ -173,38 +392,349 @@ bool ofxAlembic::Reader::open(string path)
 	m_minTime = m_root->m_minTime;
 	m_maxTime = m_root->m_maxTime;
 
+	for (int i = 0; i < object_arr.size(); i++)
+		object_arr[i]->setAttributes(m_attributes);
+
+	applySettings();
+
+	// decodes constant objects once, later setTime calls skip them
+	setTime(m_minTime);
+
 	return true;
 }
 
+void ofxAlembic::Reader::setIndexed(bool indexed)
+{
+	m_indexed = indexed;
+	applySettings();
+
+	if (m_prefetcher)
+		enablePrefetch(m_prefetcher->getNumFrames(), m_prefetcher->getFps());
+
+	setTime(current_time);
+}
+
+void ofxAlembic::Reader::setNormalMode(NormalMode mode)
+{
+	m_normalMode = mode;
+	applySettings();
+
+	if (m_prefetcher)
+		enablePrefetch(m_prefetcher->getNumFrames(), m_prefetcher->getFps());
+
+	setTime(current_time);
+}
+
+void ofxAlembic::Reader::setAttributes(unsigned int attributes)
+{
+	m_attributes = attributes;
+
+	for (int i = 0; i < object_arr.size(); i++)
+		object_arr[i]->setAttributes(m_attributes);
+
+	if (m_prefetcher)
+		enablePrefetch(m_prefetcher->getNumFrames(), m_prefetcher->getFps());
+
+	setTime(current_time);
+}
+
+void ofxAlembic::Reader::setBaked(bool baked)
+{
+	m_baked = baked;
+	applySettings();
+
+	if (m_prefetcher)
+		enablePrefetch(m_prefetcher->getNumFrames(), m_prefetcher->getFps());
+
+	setTime(current_time);
+}
+
+void ofxAlembic::Reader::setInterpolated(bool interpolated)
+{
+	m_interpolated = interpolated;
+	applySettings();
+
+	if (m_prefetcher)
+		enablePrefetch(m_prefetcher->getNumFrames(), m_prefetcher->getFps());
+
+	setTime(current_time);
+}
+
+void ofxAlembic::Reader::setLazy(bool lazy)
+{
+	m_lazy = lazy;
+	applySettings();
+
+	setTime(current_time);
+}
+
+void ofxAlembic::Reader::applySettings()
+{
+	for (int i = 0; i < object_arr.size(); i++)
+	{
+		object_arr[i]->m_baked = m_baked;
+
+		if (object_arr[i]->isTypeOf(POLYMESH))
+		{
+			IPolyMesh *polymesh = (IPolyMesh*)object_arr[i];
+			polymesh->setIndexed(m_indexed);
+			polymesh->setNormalMode(m_normalMode);
+			polymesh->setTaskPool(m_pool.get());
+		}
+	}
+
+	if (m_root)
+		m_root->setInterpolated(m_interpolated);
+
+	applyLazy();
+}
+
+void ofxAlembic::Reader::applyLazy()
+{
+	if (!m_root) return;
+
+	// lazy objects would decode over the frames prefetch swapped in, and from the current time
+	// only, the lazy time may be stale from before prefetching
+	const bool lazy = m_lazy && !m_prefetcher;
+
+	if (lazy)
+	{
+		m_lazyTime.time = current_time;
+		m_lazyTime.serial++;
+	}
+
+	m_root->setLazyTime(lazy ? &m_lazyTime : NULL);
+}
+
 void ofxAlembic::Reader::close()
 {
+	disablePrefetch();
+
 	object_arr.clear();
 	object_name_arr.clear();
 	object_map.clear();
 
-	if (m_root)
-		m_root.reset();
+	{
+		ArchiveLock lock;
 
-	if (m_archive.valid())
-		m_archive.reset();
+		if (m_root)
+			m_root.reset();
+
+		if (m_archive.valid())
+			m_archive.reset();
+	}
+
+	releaseArchive(m_format);
+	m_format = FORMAT_UNKNOWN;
 }
 
-void ofxAlembic::Reader::draw()
+bool ofxAlembic::Reader::setTime(double time)
 {
-	if (!m_root) return;
+	if (!m_root) return false;
+
+	m_totalStats.add(m_stats);
+	m_stats.clear();
+
+	// objects accessed since the previous setTime() are not evicted
+	m_accessEpoch = m_frameStart;
+	m_frameStart = ofGetElapsedTimeMicros();
+
+	OFX_ALEMBIC_TRACE("Reader::setTime", ofToString(time));
+	OFX_ALEMBIC_TIMER(&m_stats, PHASE_UPDATE);
+
+	const bool budget = m_memoryBudget > 0 && !m_prefetcher;
 
-	m_root->draw();
+	// cold objects go before decoding, evicted ones are skipped by the update
+	if (budget)
+		applyMemoryBudget();
+
+	bool ready = updateTime(time);
+
+	// the new samples can be larger than the old ones
+	if (budget)
+		applyMemoryBudget();
+
+	return ready;
 }
 
-void ofxAlembic::Reader::setTime(double time)
+bool ofxAlembic::Reader::updateTime(double time)
 {
-	if (!m_root) return;
+	current_time = time;
+
+	if (m_prefetcher)
+		return m_prefetcher->fetch(time, object_arr);
+
+	if (m_lazy)
+	{
+		m_lazyTime.time = time;
+		m_lazyTime.serial++;
+		return true;
+	}
 
 	Imath::M44f m;
 	m.makeIdentity();
-	m_root->updateWithTime(time, m);
 
-	current_time = time;
+	if (m_pool)
+	{
+		m_updateTasks.clear();
+		m_root->collectUpdates(time, m, m_updateTasks);
+
+		m_tasks.resize(m_updateTasks.size());
+		for (int i = 0; i < m_updateTasks.size(); i++)
+			m_tasks[i] = &m_updateTasks[i];
+
+		m_pool->run(m_tasks);
+	}
+	else
+	{
+		m_root->updateWithTime(time, m);
+	}
+
+	return true;
+}
+
+void ofxAlembic::Reader::setNumThreads(int num_threads)
+{
+	// prefetch slots generate normals on the pool as well
+	const bool prefetch = isPrefetchEnabled();
+	const int prefetch_frames = prefetch ? m_prefetcher->getNumFrames() : 0;
+	const float prefetch_fps = prefetch ? m_prefetcher->getFps() : 0;
+
+	disablePrefetch();
+
+	if (num_threads > 0)
+	{
+		m_pool = ofPtr<TaskPool>(new TaskPool);
+		m_pool->setup(num_threads);
+	}
+	else if (m_pool)
+	{
+		m_pool.reset();
+	}
+
+	applySettings();
+
+	if (prefetch)
+		enablePrefetch(prefetch_frames, prefetch_fps);
+}
+
+ofxAlembic::Stats ofxAlembic::Reader::getStats() const
+{
+	Stats stats = m_stats;
+
+	for (int i = 0; i < object_arr.size(); i++)
+		stats.add(object_arr[i]->getStats());
+
+	return stats;
+}
+
+ofxAlembic::Stats ofxAlembic::Reader::getTotalStats() const
+{
+	Stats stats = m_totalStats;
+	stats.add(m_stats);
+
+	for (int i = 0; i < object_arr.size(); i++)
+		stats.add(object_arr[i]->getTotalStats());
+
+	return stats;
+}
+
+ofxAlembic::MemoryUsage ofxAlembic::Reader::getMemoryUsage() const
+{
+	MemoryUsage usage;
+
+	for (int i = 0; i < object_arr.size(); i++)
+		usage.add(object_arr[i]->getMemoryUsage());
+
+	if (m_prefetcher)
+		usage.add(m_prefetcher->getMemoryUsage());
+
+	return usage;
+}
+
+void ofxAlembic::Reader::dumpMemoryUsage()
+{
+	for (int i = 0; i < object_arr.size(); i++)
+	{
+		const MemoryUsage usage = object_arr[i]->getMemoryUsage();
+
+		cout << i << ": '" << object_name_arr[i] << "' decoded " << usage.decoded
+			<< ", scratch " << usage.scratch << ", cache " << usage.cache
+			<< (object_arr[i]->isEvicted() ? " (evicted)" : "") << endl;
+	}
+
+	const MemoryUsage usage = getMemoryUsage();
+	cout << "total: decoded " << usage.decoded << ", scratch " << usage.scratch << ", cache " << usage.cache << " bytes" << endl;
+}
+
+void ofxAlembic::Reader::setMemoryBudget(size_t bytes)
+{
+	m_memoryBudget = bytes;
+}
+
+static bool compareLastAccess(const IGeom *a, const IGeom *b)
+{
+	return a->getLastAccess() < b->getLastAccess();
+}
+
+void ofxAlembic::Reader::applyMemoryBudget()
+{
+	size_t total = 0;
+	vector<IGeom*> candidates;
+
+	for (int i = 0; i < object_arr.size(); i++)
+	{
+		IGeom *o = object_arr[i];
+		total += o->getMemoryUsage().getTotal();
+
+		if (!o->isEvicted() && o->getLastAccess() < m_accessEpoch)
+			candidates.push_back(o);
+	}
+
+	if (total <= m_memoryBudget) return;
+
+	// least recently used first
+	std::sort(candidates.begin(), candidates.end(), compareLastAccess);
+
+	for (int i = 0; i < candidates.size() && total > m_memoryBudget; i++)
+	{
+		total -= candidates[i]->getMemoryUsage().getTotal();
+		candidates[i]->evict();
+	}
+}
+
+void ofxAlembic::Reader::resetStats()
+{
+	m_stats.clear();
+	m_totalStats.clear();
+
+	if (m_root)
+		m_root->resetStats();
+}
+
+int ofxAlembic::Reader::getNumThreads() const
+{
+	return m_pool ? m_pool->getNumThreads() : 0;
+}
+
+void ofxAlembic::Reader::enablePrefetch(int num_frames, float fps)
+{
+	disablePrefetch();
+
+	if (!m_archive.valid()) return;
+
+	m_prefetcher = ofPtr<Prefetcher>(new Prefetcher);
+	m_prefetcher->setup(m_archive, object_arr, num_frames, fps);
+
+	applyLazy();
+}
+
+void ofxAlembic::Reader::disablePrefetch()
+{
+	if (!m_prefetcher) return;
+
+	m_prefetcher.reset();
+	applyLazy();
 }
 
 void ofxAlembic::Reader::dumpNames()
@@ -259,11 +789,27 @@ bool ofxAlembic::Reader::get(size_t idx, vector<ofVec3f>& points)
 	return o->get(points);
 }
 
+bool ofxAlembic::Reader::getTransform(const string& path, ofMatrix4x4& transform)
+{
+	IGeom *o = get(path);
+	if (o == NULL) return false;
+	transform = o->getTransform();
+	return true;
+}
+
+bool ofxAlembic::Reader::getTransform(size_t idx, ofMatrix4x4& transform)
+{
+	IGeom *o = get(idx);
+	if (o == NULL) return false;
+	transform = o->getTransform();
+	return true;
+}
+
 #pragma mark - IGeom
 
-IGeom::IGeom() : m_minTime(0), m_maxTime(0), type(UNKHOWN) {}
+IGeom::IGeom() : m_parent(NULL), m_lazyTime(NULL), m_lazySerial(0), m_baked(true), m_interpolated(false), m_attributes(ATTRIBUTE_ALL), m_evicted(false), m_updateTime(0), m_lastAccess(0), m_minTime(0), m_maxTime(0), m_numSamples(0), m_sampleIndex(-1), m_sampleAlpha(0), type(UNKHOWN) {}
 
-IGeom::IGeom(Alembic::AbcGeom::IObject object) : m_object(object), m_minTime(0), m_maxTime(0), type(UNKHOWN)
+IGeom::IGeom(Alembic::AbcGeom::IObject object) : m_object(object), m_parent(NULL), m_lazyTime(NULL), m_lazySerial(0), m_baked(true), m_interpolated(false), m_attributes(ATTRIBUTE_ALL), m_evicted(false), m_updateTime(0), m_lastAccess(0), m_minTime(0), m_maxTime(0), m_numSamples(0), m_sampleIndex(-1), m_sampleAlpha(0), type(UNKHOWN)
 {
 	type = UNKHOWN;
 	setupWithObject(m_object);
@@ -351,6 +897,7 @@ void IGeom::setupWithObject(IObject object)
 
 		if (dptr && dptr->valid())
 		{
+			dptr->m_parent = this;
 			m_children.push_back(dptr);
 			m_minTime = std::min(m_minTime, dptr->m_minTime);
 			m_maxTime = std::max(m_maxTime, dptr->m_maxTime);
@@ -358,25 +905,60 @@ void IGeom::setupWithObject(IObject object)
 	}
 }
 
-void IGeom::draw()
+const M44f& IGeom::getBakeTransform(const M44f& world) const
 {
-	drawInternal();
+	return m_baked ? world : identity_matrix;
+}
+
+void IGeom::swapState(IGeom& other)
+{
+	std::swap(m_sampleIndex, other.m_sampleIndex);
+	std::swap(m_sampleTransform, other.m_sampleTransform);
+	std::swap(m_sampleAlpha, other.m_sampleAlpha);
+	m_blend.swap(other.m_blend);
+	std::swap(m_world, other.m_world);
+	std::swap(m_stats, other.m_stats);
+
+	// whatever was evicted is decoded from scratch by the slot
+	m_evicted = other.m_evicted = false;
+}
+
+void IGeom::setAttributes(unsigned int attributes)
+{
+	if (m_attributes == attributes) return;
+
+	m_attributes = attributes;
+	m_sampleIndex = -1;
+
+	// the next sample was read with the old mask
+	m_blend.reset();
+}
+
+void IGeom::setInterpolated(bool interpolated)
+{
+	m_interpolated = interpolated;
 
 	for (int i = 0; i < m_children.size(); i++)
-	{
-		ofPtr<IGeom> c = m_children[i];
-		c->draw();
-	}
+		m_children[i]->setInterpolated(interpolated);
 }
 
-void IGeom::drawTextured( ofImage *tex ){
-	drawInternalTextured( tex );
+void IGeom::evict()
+{
+	if (isTypeOf(UNKHOWN) || m_evicted) return;
+
+	releaseState();
+	m_blend.reset();
+	m_sampleIndex = -1;
+	m_evicted = true;
+}
+
+void IGeom::resetStats()
+{
+	m_stats.clear();
+	m_totalStats.clear();
 
 	for (int i = 0; i < m_children.size(); i++)
-	{
-		ofPtr<IGeom> c = m_children[i];
-		c->drawTextured( tex );
-	}
+		m_children[i]->resetStats();
 }
 
 string IGeom::getName() const
@@ -384,13 +966,107 @@ string IGeom::getName() const
 	return m_object.getFullName();
 }
 
-void IGeom::updateWithTime(double time, Imath::M44f& transform)
+ofxAlembic::Stats IGeom::getTotalStats() const
+{
+	Stats stats = m_totalStats;
+	stats.add(m_stats);
+	return stats;
+}
+
+void IGeom::update(double time, Imath::M44f& transform)
 {
+	// the previous frame, including get() copies made from it, goes into the totals
+	m_totalStats.add(m_stats);
+	m_stats.clear();
+
+	// evicted objects only remember the time, evaluate() decodes them on access
+	m_updateTime = time;
+	if (m_evicted) return;
+
+	OFX_ALEMBIC_TRACE("IGeom::update", getName());
 	updateWithTimeInternal(time, transform);
+}
+
+bool IGeom::updateWithTime(double time, Imath::M44f& transform, UpdateCancel *cancel)
+{
+	if (cancel && cancel->isCancelled()) return false;
+
+	update(time, transform);
+	m_world = transform;
 
 	for (int i = 0; i < m_children.size(); i++)
 	{
 		Imath::M44f m = transform;
-		m_children[i]->updateWithTime(time, m);
+		if (!m_children[i]->updateWithTime(time, m, cancel)) return false;
+	}
+
+	return true;
+}
+
+const Imath::M44f& IGeom::evaluate()
+{
+	m_lastAccess = ofGetElapsedTimeMicros();
+
+	if (m_lazyTime && m_lazySerial != m_lazyTime->serial)
+	{
+		// parents resolve their own transform first, siblings stay untouched
+		Imath::M44f m;
+		if (m_parent) m = m_parent->evaluate();
+		else m.makeIdentity();
+
+		update(m_lazyTime->time, m);
+
+		m_world = m;
+		m_lazySerial = m_lazyTime->serial;
 	}
-}
\ No newline at end of file
+
+	if (m_evicted)
+	{
+		m_evicted = false;
+
+		Imath::M44f m = m_world;
+		update(m_updateTime, m);
+	}
+
+	return m_world;
+}
+
+void IGeom::setLazyTime(const LazyTime* lazy_time)
+{
+	m_lazyTime = lazy_time;
+	m_lazySerial = lazy_time ? lazy_time->serial - 1 : 0;
+
+	for (int i = 0; i < m_children.size(); i++)
+		m_children[i]->setLazyTime(lazy_time);
+}
+
+void IGeom::collectUpdates(double time, Imath::M44f& transform, vector<UpdateTask>& tasks)
+{
+	// transforms are cheap and needed by the children, resolve them right away
+	if (isTypeOf(UNKHOWN))
+	{
+		update(time, transform);
+		m_world = transform;
+	}
+	else
+	{
+		UpdateTask task;
+		task.geom = this;
+		task.time = time;
+		task.transform = transform;
+		tasks.push_back(task);
+
+		m_world = transform;
+	}
+
+	for (int i = 0; i < m_children.size(); i++)
+	{
+		Imath::M44f m = transform;
+		m_children[i]->collectUpdates(time, m, tasks);
+	}
+}
+
+void ofxAlembic::UpdateTask::run()
+{
+	geom->update(time, transform);
+}
@@ -8,11 +8,17 @@
 
 #include "ofxAlembicUtil.h"
 #include "ofxAlembicType.h"
+#include "ofxAlembicTaskPool.h"
 
 namespace ofxAlembic
 {
 class Reader;
 class IGeom;
+class Prefetcher;
+
+struct LazyTime;
+struct UpdateTask;
+struct UpdateCancel;
 
 class IXform;
 class IPoints;
@@ -32,24 +38,105 @@ template <>
 inline ofxAlembic::Type type2enum<ofxAlembic::PolyMesh>() { return ofxAlembic::POLYMESH; }
 }
 
+// decode of one object, run on the reader's task pool
+
+struct ofxAlembic::UpdateTask : public ofxAlembic::TaskPool::Task
+{
+	IGeom *geom;
+	double time;
+	Imath::M44f transform;
+
+	void run();
+};
+
+// polled before every object of a tree update, returning true stops the update
+
+struct ofxAlembic::UpdateCancel
+{
+	virtual ~UpdateCancel() {}
+	virtual bool isCancelled() = 0;
+};
+
+// time requested from a lazy reader, objects re-evaluate when `serial` moved on
+
+struct ofxAlembic::LazyTime
+{
+	double time;
+	unsigned int serial;
+
+	LazyTime() : time(0), serial(0) {}
+};
+
 class ofxAlembic::Reader
 {
 public:
 
-	~Reader() {}
+	Reader() : m_format(FORMAT_UNKNOWN), current_time(0), m_indexed(false), m_normalMode(NORMAL_NONE), m_baked(true), m_interpolated(false), m_attributes(ATTRIBUTE_ALL), m_lazy(false), m_memoryBudget(0), m_frameStart(0), m_accessEpoch(0) {}
+	~Reader() { close(); }
 
+	// HDF5 or Ogawa, detected from the file
 	bool open(string path);
 	void close();
+
+	inline Format getFormat() const { return m_format; }
 	
 	void dumpNames();
 
-	void setTime(double time);
+	// returns false if prefetch is enabled and the frame was not ready yet
+	bool setTime(double time);
 	float getTime() const { return current_time; }
 
+	// decode `num_frames` frames ahead of the playhead on a background thread.
+	// setTime() then snaps to 1/fps and only swaps in the prebuilt state.
+	void enablePrefetch(int num_frames = 8, float fps = 30);
+	void disablePrefetch();
+
+	inline bool isPrefetchEnabled() const { return m_prefetcher.get() != NULL; }
+	inline Prefetcher* getPrefetcher() { return m_prefetcher.get(); }
+
+	// setTime() only records the time, each object is decoded on its first get(), getView() or draw().
+	// ignored while prefetching, prefetched frames are swapped in whole
+	void setLazy(bool lazy);
+	inline bool isLazy() const { return m_lazy; }
+
+	// decode objects on `num_threads` worker threads, 0 decodes on the calling thread.
+	// HDF5 reads are serialized, conversion of sibling objects runs concurrently.
+	// Ogawa archives opened after this get one read stream per thread.
+	void setNumThreads(int num_threads);
+	int getNumThreads() const;
+
+	// emit polymeshes as shared vertices plus an index buffer instead of a triangle soup. corners are merged
+	// where uvs and normals match, animated ones are welded again when a sample splits them apart.
+	void setIndexed(bool indexed);
+	inline bool isIndexed() const { return m_indexed; }
+
+	// generate smooth or flat normals for polymeshes stored without any, on the worker threads when
+	// setNumThreads() is used. views keep returning the archive samples only.
+	void setNormalMode(NormalMode mode);
+	inline NormalMode getNormalMode() const { return m_normalMode; }
+
+	// ATTRIBUTE_* bits of what every object fetches and converts, e.g. ATTRIBUTE_POSITIONS for a depth pass.
+	// overrides masks set on single objects with IGeom::setAttributes()
+	void setAttributes(unsigned int attributes);
+	inline unsigned int getAttributes() const { return m_attributes; }
+
+	// multiply the xform hierarchy into the vertices (default). when disabled geometry stays
+	// in object space, getTransform() returns the world matrix and rigid animation never re-decodes.
+	void setBaked(bool baked);
+	inline bool isBaked() const { return m_baked; }
+
+	// blend the samples before and after the time instead of snapping to the nearest one. positions, normals
+	// and xforms are interpolated while both samples have the same topology, otherwise the nearer one is used.
+	// while prefetching the time is still snapped to the prefetch fps first.
+	void setInterpolated(bool interpolated);
+	inline bool isInterpolated() const { return m_interpolated; }
+
 	inline float getMinTime() const { return m_minTime; }
 	inline float getMaxTime() const { return m_maxTime; }
 
+#ifndef OFX_ALEMBIC_NO_GL
 	void draw();
+#endif
 
 	inline size_t size() const { return object_arr.size(); }
 	inline const vector<string>& getNames() const { return object_name_arr; }
@@ -62,6 +149,29 @@ public:
 	bool get(size_t idx, vector<ofPolyline>& curves);
 	bool get(size_t idx, vector<ofVec3f>& points);
 
+	bool getTransform(const string& path, ofMatrix4x4& transform);
+	bool getTransform(size_t idx, ofMatrix4x4& transform);
+
+	// time spent per phase in the last setTime() and the objects it decoded,
+	// and the same summed up since open() or resetStats()
+	Stats getStats() const;
+	Stats getTotalStats() const;
+	void resetStats();
+
+	// bytes held by all objects, prefetched frames included
+	MemoryUsage getMemoryUsage() const;
+	void dumpMemoryUsage();
+
+	// setTime() evicts the objects not accessed through get(), getView() or draw() for the longest time until
+	// the decoded state fits into `bytes`, before and after decoding, 0 disables. ignored while prefetching.
+	// the budget is soft: objects accessed during the last frame are kept, so it can overshoot by their new frame.
+	void setMemoryBudget(size_t bytes);
+	inline size_t getMemoryBudget() const { return m_memoryBudget; }
+
+	// PolyMeshView, PointsView or CurvesView of the current samples, no data is copied
+	template <typename T>
+	bool getView(const string& path, T& view);
+
 	inline IGeom* get(size_t idx) { return object_arr[idx]; }
 	
 	IGeom* get(const string& path)
@@ -73,8 +183,10 @@ public:
 protected:
 
 	Alembic::AbcGeom::IArchive m_archive;
+	Format m_format;
 
 	ofPtr<IGeom> m_root;
+	ofPtr<Prefetcher> m_prefetcher;
 
 	map<string, IGeom*> object_map;
 	vector<IGeom*> object_arr;
@@ -84,6 +196,31 @@ protected:
 	Alembic::AbcGeom::chrono_t m_maxTime;
 
 	float current_time;
+
+	Stats m_stats;
+	Stats m_totalStats;
+
+	bool m_indexed;
+	NormalMode m_normalMode;
+	bool m_baked;
+	bool m_interpolated;
+	unsigned int m_attributes;
+
+	bool m_lazy;
+	LazyTime m_lazyTime;
+
+	size_t m_memoryBudget;
+	unsigned long long m_frameStart;
+	unsigned long long m_accessEpoch;
+
+	ofPtr<TaskPool> m_pool;
+	vector<UpdateTask> m_updateTasks;
+	vector<TaskPool::Task*> m_tasks;
+
+	void applySettings();
+	void applyLazy();
+	bool updateTime(double time);
+	void applyMemoryBudget();
 };
 
 // Geom
@@ -91,6 +228,8 @@ protected:
 class ofxAlembic::IGeom
 {
 	friend class Reader;
+	friend class Prefetcher;
+	friend struct UpdateTask;
 
 public:
 
@@ -100,8 +239,40 @@ public:
 
 	virtual bool valid() { return m_object; }
 
+#ifndef OFX_ALEMBIC_NO_GL
 	void draw();
 	void drawTextured( ofImage *tex = NULL );
+#endif
+
+	// brings a lazy object up to the reader's time, returns its world transform
+	const Imath::M44f& evaluate();
+
+	// world transform, already applied to the vertices unless the reader is unbaked
+	ofMatrix4x4 getTransform() { return toOf(evaluate()); }
+
+	inline bool isBaked() const { return m_baked; }
+
+	// blends sub-frame times from the two samples around them, applies to all children
+	void setInterpolated(bool interpolated);
+	inline bool isInterpolated() const { return m_interpolated; }
+
+	// ATTRIBUTE_* bits this object fetches, masked out attributes are freed on the next update
+	virtual void setAttributes(unsigned int attributes);
+	inline unsigned int getAttributes() const { return m_attributes; }
+
+	// phases of the last decode of this object, and all of them since the last resetStats()
+	inline const Stats& getStats() const { return m_stats; }
+	Stats getTotalStats() const;
+	void resetStats();
+
+	virtual MemoryUsage getMemoryUsage() const { return MemoryUsage(); }
+
+	// frees the decoded state, the object is decoded again on its next access
+	void evict();
+	inline bool isEvicted() const { return m_evicted; }
+
+	// ofGetElapsedTimeMicros() of the last get(), getView() or draw()
+	inline unsigned long long getLastAccess() const { return m_lastAccess; }
 
 	string getName() const;
 	virtual const char* getTypeName() const { return ""; }
@@ -118,28 +289,146 @@ public:
 		return false;
 	}
 
+	// zero-copy access to the samples the current state was decoded from
+	template <typename T>
+	inline bool getView(T &out)
+	{
+		ofLogError("ofxAlembic::IGeom") << "invalid type";
+		return false;
+	}
+
 protected:
 
 	Type type;
 
 	Alembic::AbcGeom::IObject m_object;
 	vector<ofPtr<IGeom> > m_children;
+	IGeom* m_parent;
+
+	const LazyTime* m_lazyTime;
+	unsigned int m_lazySerial;
+	Imath::M44f m_world;
+
+	bool m_baked;
+	bool m_interpolated;
+	unsigned int m_attributes;
+
+	Stats m_stats;
+	Stats m_totalStats;
+
+	bool m_evicted;
+	double m_updateTime;
+	unsigned long long m_lastAccess;
+
+	// transform the vertices are decoded with, identity when unbaked
+	const Imath::M44f& getBakeTransform(const Imath::M44f& world) const;
+
+	void setLazyTime(const LazyTime* lazy_time);
 
 	virtual void setupWithObject(Alembic::AbcGeom::IObject);
-	void updateWithTime(double time, Imath::M44f& transform);
+	// returns false when `cancel` stopped it, the objects not reached keep their previous state
+	bool updateWithTime(double time, Imath::M44f& transform, UpdateCancel *cancel = NULL);
+	void update(double time, Imath::M44f& transform);
+	void collectUpdates(double time, Imath::M44f& transform, vector<UpdateTask>& tasks);
 
 	virtual void updateWithTimeInternal(double time, Imath::M44f& transform) {}
+	virtual void releaseState() {}
+	virtual void swapState(IGeom& other);
+	virtual void copySettings(const IGeom& other)
+	{
+		m_baked = other.m_baked;
+		m_interpolated = other.m_interpolated;
+		setAttributes(other.m_attributes);
+	}
+#ifndef OFX_ALEMBIC_NO_GL
 	virtual void drawInternal() {}
 	virtual void drawInternalTextured( ofImage *tex ) {}
+#endif
 
 	Alembic::AbcGeom::chrono_t m_minTime;
 	Alembic::AbcGeom::chrono_t m_maxTime;
 
+	// time sampling of the schema, 1 sample when it is constant. read once by setSampling() while the
+	// archive is locked during construction, so updates never touch the schema for it
+	Alembic::AbcGeom::TimeSamplingPtr m_timeSampling;
+	size_t m_numSamples;
+
+	// the sample and parent transform the current state was decoded with,
+	// and how far it was blended towards the next sample
+	Alembic::AbcGeom::index_t m_sampleIndex;
+	Imath::M44f m_sampleTransform;
+	float m_sampleAlpha;
+
+	// the next sample while interpolating
+	SampleBlend m_blend;
+
+	inline bool isSampleDecoded(Alembic::AbcGeom::index_t index, const Imath::M44f& transform) const
+	{
+		return m_sampleIndex == index && m_sampleTransform == transform;
+	}
+
+	inline bool isSampleCurrent(Alembic::AbcGeom::index_t index, const Imath::M44f& transform, float alpha = 0) const
+	{
+		return isSampleDecoded(index, transform) && m_sampleAlpha == alpha;
+	}
+
+	inline void setSampleCurrent(Alembic::AbcGeom::index_t index, const Imath::M44f& transform, float alpha = 0)
+	{
+		m_sampleIndex = index;
+		m_sampleTransform = transform;
+		m_sampleAlpha = alpha;
+	}
+
+	template <typename T>
+	void setSampling(const T& schema)
+	{
+		m_timeSampling = schema.getTimeSampling();
+		m_numSamples = schema.isConstant() ? 1 : schema.getNumSamples();
+
+		if (!schema.isConstant() && m_numSamples > 0)
+		{
+			m_minTime = std::min(m_minTime, m_timeSampling->getSampleTime(0));
+			m_maxTime = std::max(m_maxTime, m_timeSampling->getSampleTime(m_numSamples - 1));
+		}
+	}
+
+	inline Alembic::AbcGeom::index_t getSampleIndex(double time) const
+	{
+		using namespace Alembic::AbcGeom;
+
+		if (m_numSamples <= 1) return 0;
+
+		ISampleSelector ss(time, ISampleSelector::kNearIndex);
+		return ss.getIndex(m_timeSampling, m_numSamples);
+	}
+
+	// the samples before and after `time` and the weight of the later one. false when interpolation
+	// is off, the schema does not vary or `time` is on a sample, getSampleIndex() applies then
+	bool getSampleBracket(double time, Alembic::AbcGeom::index_t& floor, Alembic::AbcGeom::index_t& ceil, float& alpha) const
+	{
+		using namespace Alembic::AbcGeom;
+
+		if (!m_interpolated || m_numSamples <= 1) return false;
+
+		floor = ISampleSelector(time, ISampleSelector::kFloorIndex).getIndex(m_timeSampling, m_numSamples);
+		ceil = ISampleSelector(time, ISampleSelector::kCeilIndex).getIndex(m_timeSampling, m_numSamples);
+		if (floor == ceil) return false;
+
+		const chrono_t t0 = m_timeSampling->getSampleTime(floor);
+		const chrono_t t1 = m_timeSampling->getSampleTime(ceil);
+		if (t1 <= t0) return false;
+
+		alpha = (time - t0) / (t1 - t0);
+		return alpha > 0 && alpha < 1;
+	}
+
 	static void visit_geoms(ofPtr<IGeom> &obj, map<string, IGeom*> &object_map);
 };
 
 class ofxAlembic::IPoints : public ofxAlembic::IGeom
 {
+	friend class IGeom;
+
 public:
 
 	Points points;
@@ -153,18 +442,36 @@ public:
 
 	const char* getTypeName() const { return "Points"; }
 
+	MemoryUsage getMemoryUsage() const;
+
 protected:
 
 	Alembic::AbcGeom::IPoints m_points;
+	PointsView m_view;
 
 	void updateWithTimeInternal(double time, Imath::M44f& transform);
+	void releaseState()
+	{
+		points.release();
+		m_view.reset();
+	}
+	void swapState(IGeom& other)
+	{
+		IGeom::swapState(other);
+		points.swap(((IPoints&)other).points);
+		m_view.swap(((IPoints&)other).m_view);
+	}
+#ifndef OFX_ALEMBIC_NO_GL
 	void drawInternal() { 
 		points.draw(); 
 	}
+#endif
 };
 
 class ofxAlembic::ICurves : public ofxAlembic::IGeom
 {
+	friend class IGeom;
+
 public:
 
 	Curves curves;
@@ -178,18 +485,36 @@ public:
 
 	const char* getTypeName() const { return "Curves"; }
 
+	MemoryUsage getMemoryUsage() const;
+
 protected:
 
 	Alembic::AbcGeom::ICurves m_curves;
+	CurvesView m_view;
 
 	void updateWithTimeInternal(double time, Imath::M44f& transform);
+	void releaseState()
+	{
+		curves.release();
+		m_view.reset();
+	}
+	void swapState(IGeom& other)
+	{
+		IGeom::swapState(other);
+		curves.swap(((ICurves&)other).curves);
+		m_view.swap(((ICurves&)other).m_view);
+	}
+#ifndef OFX_ALEMBIC_NO_GL
 	void drawInternal() { 
 		curves.draw(); 
 	}
+#endif
 };
 
 class ofxAlembic::IPolyMesh : public ofxAlembic::IGeom
 {
+	friend class IGeom;
+
 public:
 
 	PolyMesh polymesh;
@@ -203,17 +528,59 @@ public:
 
 	const char* getTypeName() const { return "PolyMesh"; }
 
+	void setIndexed(bool indexed);
+	inline bool isIndexed() const { return m_topology.indexed; }
+
+	void setNormalMode(NormalMode mode);
+	inline NormalMode getNormalMode() const { return m_topology.normal_mode; }
+
+	// pool the normal generation is split over, NULL generates on the decoding thread
+	inline void setTaskPool(TaskPool *pool) { m_topology.pool = pool; }
+	inline TaskPool* getTaskPool() const { return m_topology.pool; }
+
+	void setAttributes(unsigned int attributes);
+
+	MemoryUsage getMemoryUsage() const;
+
 protected:
 
 	Alembic::AbcGeom::IPolyMesh m_polyMesh;
+	PolyMeshView m_view;
+	PolyMeshTopology m_topology;
+
+	// face layout varies between samples, read with the time sampling
+	bool m_heterogenous;
 
 	void updateWithTimeInternal(double time, Imath::M44f& transform);
+	void decode(Alembic::AbcGeom::index_t index, const Imath::M44f& transform);
+	void releaseState()
+	{
+		polymesh.release();
+		m_topology.release();
+		m_view.reset();
+	}
+	void swapState(IGeom& other)
+	{
+		IGeom::swapState(other);
+		polymesh.swap(((IPolyMesh&)other).polymesh);
+		m_view.swap(((IPolyMesh&)other).m_view);
+		m_topology.swap(((IPolyMesh&)other).m_topology);
+	}
+	void copySettings(const IGeom& other)
+	{
+		IGeom::copySettings(other);
+		setIndexed(((const IPolyMesh&)other).isIndexed());
+		setNormalMode(((const IPolyMesh&)other).getNormalMode());
+		setTaskPool(((const IPolyMesh&)other).getTaskPool());
+	}
+#ifndef OFX_ALEMBIC_NO_GL
 	void drawInternal() { 
 		polymesh.draw(); 
 	}
 	void drawInternalTextured( ofImage *tex ) { 
 		polymesh.drawTextured( tex ); 
 	}
+#endif
 };
 
 //
@@ -227,6 +594,8 @@ inline bool ofxAlembic::IGeom::get(ofxAlembic::Points &o)
 		return false;
 	}
 
+	evaluate();
+	OFX_ALEMBIC_TIMER(&m_stats, PHASE_COPY);
 	o = ((IPoints*)this)->points;
 	return true;
 }
@@ -240,7 +609,9 @@ inline bool ofxAlembic::IGeom::get(vector<ofxAlembic::Point> &o)
 		return false;
 	}
 
-	o = ((IPoints*)this)->points.points;
+	evaluate();
+	OFX_ALEMBIC_TIMER(&m_stats, PHASE_COPY);
+	((IPoints*)this)->points.getPoints(o);
 	return true;
 }
 
@@ -253,7 +624,9 @@ inline bool ofxAlembic::IGeom::get(vector<ofVec3f> &o)
 		return false;
 	}
 
-	o = toOf(((IPoints*)this)->points.points);
+	evaluate();
+	OFX_ALEMBIC_TIMER(&m_stats, PHASE_COPY);
+	o = ((IPoints*)this)->points.positions;
 	return true;
 }
 
@@ -266,6 +639,8 @@ inline bool ofxAlembic::IGeom::get(ofxAlembic::Curves &o)
 		return false;
 	}
 
+	evaluate();
+	OFX_ALEMBIC_TIMER(&m_stats, PHASE_COPY);
 	o = ((ICurves*)this)->curves;
 	return true;
 }
@@ -279,7 +654,9 @@ inline bool ofxAlembic::IGeom::get(vector<ofPolyline> &o)
 		return false;
 	}
 
-	o = ((ICurves*)this)->curves.curves;
+	evaluate();
+	OFX_ALEMBIC_TIMER(&m_stats, PHASE_COPY);
+	((ICurves*)this)->curves.getPolylines(o);
 	return true;
 }
 
@@ -292,6 +669,8 @@ inline bool ofxAlembic::IGeom::get(ofxAlembic::PolyMesh &o)
 		return false;
 	}
 
+	evaluate();
+	OFX_ALEMBIC_TIMER(&m_stats, PHASE_COPY);
 	o = ((IPolyMesh*)this)->polymesh;
 	return true;
 }
@@ -305,6 +684,58 @@ inline bool ofxAlembic::IGeom::get(ofMesh &o)
 		return false;
 	}
 
+	evaluate();
+	OFX_ALEMBIC_TIMER(&m_stats, PHASE_COPY);
 	o = ((IPolyMesh*)this)->polymesh.mesh;
 	return true;
+}
+
+template <>
+inline bool ofxAlembic::IGeom::getView(ofxAlembic::PointsView &o)
+{
+	if (type != ofxAlembic::POINTS)
+	{
+		ofLogError("ofxAlembic::IGeom") << "cast error";
+		return false;
+	}
+
+	evaluate();
+	o = ((IPoints*)this)->m_view;
+	return true;
+}
+
+template <>
+inline bool ofxAlembic::IGeom::getView(ofxAlembic::CurvesView &o)
+{
+	if (type != ofxAlembic::CURVES)
+	{
+		ofLogError("ofxAlembic::IGeom") << "cast error";
+		return false;
+	}
+
+	evaluate();
+	o = ((ICurves*)this)->m_view;
+	return true;
+}
+
+template <>
+inline bool ofxAlembic::IGeom::getView(ofxAlembic::PolyMeshView &o)
+{
+	if (type != ofxAlembic::POLYMESH)
+	{
+		ofLogError("ofxAlembic::IGeom") << "cast error";
+		return false;
+	}
+
+	evaluate();
+	o = ((IPolyMesh*)this)->m_view;
+	return true;
+}
+
+template <typename T>
+inline bool ofxAlembic::Reader::getView(const string& path, T& view)
+{
+	IGeom *o = get(path);
+	if (o == NULL) return false;
+	return o->getView(view);
 }
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include "ofxAlembicStats.h"
+
+using namespace ofxAlembic;
+
+const char* ofxAlembic::getPhaseName(Phase phase)
+{
+	switch (phase)
+	{
+		case PHASE_READ: return "read";
+		case PHASE_TRIANGULATE: return "triangulate";
+		case PHASE_TRANSFORM: return "transform";
+		case PHASE_BUILD: return "build";
+		case PHASE_NORMALS: return "normals";
+		case PHASE_INTERPOLATE: return "interpolate";
+		case PHASE_COPY: return "copy";
+		case PHASE_UPDATE: return "update";
+		case PHASE_CONVERT: return "convert";
+		case PHASE_DIGEST: return "digest";
+		case PHASE_WRITE: return "write";
+		default: return "unknown";
+	}
+}
+
+void Stats::clear()
+{
+	for (int i = 0; i < NUM_PHASES; i++)
+	{
+		micros[i] = 0;
+		calls[i] = 0;
+	}
+}
+
+void Stats::add(const Stats& other)
+{
+	for (int i = 0; i < NUM_PHASES; i++)
+	{
+		micros[i] += other.micros[i];
+		calls[i] += other.calls[i];
+	}
+}
+
+string Stats::toString() const
+{
+	ostringstream o;
+
+	for (int i = 0; i < NUM_PHASES; i++)
+	{
+		if (calls[i] == 0) continue;
+
+		if (o.tellp() > 0) o << ", ";
+		o << getPhaseName((Phase)i) << " " << getTime((Phase)i) << "ms";
+	}
+
+	return o.str();
+}
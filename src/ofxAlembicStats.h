@@ -0,0 +1,86 @@
+#pragma once
+
+#include "ofMain.h"
+
+// define OFX_ALEMBIC_NO_STATS to compile the timers out, the accessors then report zeros
+
+namespace ofxAlembic
+{
+struct Stats;
+class ScopedTimer;
+
+enum Phase
+{
+	PHASE_READ = 0, // archive access, including the wait for the archive lock
+	PHASE_TRIANGULATE, // triangulation and welding of a new face layout
+	PHASE_TRANSFORM, // matrix applied to positions and normals
+	PHASE_BUILD, // gathering samples into ofMesh, curve or point arrays
+	PHASE_NORMALS, // reader side normal generation
+	PHASE_INTERPOLATE, // blending two samples for sub-frame times
+	PHASE_COPY, // get() copies and async writer handoff
+	PHASE_UPDATE, // Reader::setTime wall time
+	PHASE_CONVERT, // writer, ofMesh etc. to Alembic samples
+	PHASE_DIGEST, // writer, topology hash deciding whether the face layout is written
+	PHASE_WRITE, // writer, schema.set
+	NUM_PHASES
+};
+
+const char* getPhaseName(Phase phase);
+}
+
+struct ofxAlembic::Stats
+{
+	unsigned long long micros[NUM_PHASES];
+	unsigned int calls[NUM_PHASES];
+
+	Stats() { clear(); }
+
+	void clear();
+	void add(const Stats& other);
+
+	inline void add(Phase phase, unsigned long long us)
+	{
+		micros[phase] += us;
+		calls[phase]++;
+	}
+
+	// milliseconds
+	inline float getTime(Phase phase) const { return micros[phase] / 1000.f; }
+	inline unsigned int getCalls(Phase phase) const { return calls[phase]; }
+
+	string toString() const;
+};
+
+class ofxAlembic::ScopedTimer
+{
+public:
+
+	ScopedTimer(Stats *stats, Phase phase) : stats(stats), phase(phase), start(stats ? ofGetElapsedTimeMicros() : 0) {}
+
+	~ScopedTimer() { stop(); }
+
+	// records now instead of at the end of the scope
+	inline void stop()
+	{
+		if (stats) stats->add(phase, ofGetElapsedTimeMicros() - start);
+		stats = NULL;
+	}
+
+private:
+
+	Stats *stats;
+	Phase phase;
+	unsigned long long start;
+
+	ScopedTimer(const ScopedTimer&);
+	ScopedTimer& operator=(const ScopedTimer&);
+};
+
+// times the rest of the enclosing scope into `stats` (may be NULL)
+#ifdef OFX_ALEMBIC_NO_STATS
+#define OFX_ALEMBIC_TIMER(stats, phase)
+#define OFX_ALEMBIC_TIMER_STOP(phase)
+#else
+#define OFX_ALEMBIC_TIMER(stats, phase) ofxAlembic::ScopedTimer ofx_alembic_timer_##phase((stats), ofxAlembic::phase)
+#define OFX_ALEMBIC_TIMER_STOP(phase) ofx_alembic_timer_##phase.stop()
+#endif
@@ -0,0 +1,179 @@
+#include "ofxAlembicTaskPool.h"
+
+using namespace ofxAlembic;
+
+TaskPool::TaskPool()
+{
+}
+
+TaskPool::~TaskPool()
+{
+	clear();
+}
+
+void TaskPool::setup(int num_threads)
+{
+	clear();
+
+	for (int i = 0; i < num_threads; i++)
+	{
+		Worker *w = new Worker;
+		w->pool = this;
+		w->index = i;
+		workers.push_back(w);
+	}
+
+	for (int i = 0; i < workers.size(); i++)
+		workers[i]->startThread(true, false);
+}
+
+void TaskPool::clear()
+{
+	for (int i = 0; i < workers.size(); i++)
+		workers[i]->stopThread();
+
+	mutex.lock();
+	work_condition.broadcast();
+	mutex.unlock();
+
+	for (int i = 0; i < workers.size(); i++)
+	{
+		workers[i]->waitForThread(false);
+		delete workers[i];
+	}
+
+	workers.clear();
+}
+
+void TaskPool::run(const vector<Task*>& tasks)
+{
+	if (tasks.empty()) return;
+	run(&tasks[0], tasks.size());
+}
+
+void TaskPool::run(Task* const *tasks, size_t num_tasks)
+{
+	if (num_tasks == 0) return;
+
+	if (workers.empty())
+	{
+		for (size_t i = 0; i < num_tasks; i++)
+			tasks[i]->run();
+		return;
+	}
+
+	// every call counts its own tasks, nested and concurrent calls only wait for their own batch
+	int pending = num_tasks;
+
+	for (size_t i = 0; i < num_tasks; i++)
+	{
+		Worker *w = workers[i % workers.size()];
+		tasks[i]->pending = &pending;
+
+		ofScopedLock lock(w->queue_mutex);
+		w->queue.push_back(tasks[i]);
+	}
+
+	mutex.lock();
+	work_condition.broadcast();
+	mutex.unlock();
+
+	// help out until the last task finished, possibly running tasks of other batches
+	while (true)
+	{
+		Task *task = steal(-1);
+		if (task)
+		{
+			execute(task);
+			continue;
+		}
+
+		ofScopedLock lock(mutex);
+		if (pending == 0) break;
+		done_condition.wait(mutex);
+	}
+}
+
+TaskPool::Task* TaskPool::pop(int index)
+{
+	Worker *w = workers[index];
+	ofScopedLock lock(w->queue_mutex);
+
+	if (w->queue.empty()) return NULL;
+
+	Task *task = w->queue.back();
+	w->queue.pop_back();
+	return task;
+}
+
+TaskPool::Task* TaskPool::steal(int thief)
+{
+	const int num = workers.size();
+	const int start = thief < 0 ? 0 : thief + 1;
+
+	for (int i = 0; i < num; i++)
+	{
+		Worker *w = workers[(start + i) % num];
+		if (w->index == thief) continue;
+
+		ofScopedLock lock(w->queue_mutex);
+
+		if (w->queue.empty()) continue;
+
+		Task *task = w->queue.front();
+		w->queue.pop_front();
+		return task;
+	}
+
+	return NULL;
+}
+
+bool TaskPool::hasQueued()
+{
+	for (int i = 0; i < workers.size(); i++)
+	{
+		ofScopedLock lock(workers[i]->queue_mutex);
+		if (!workers[i]->queue.empty()) return true;
+	}
+	return false;
+}
+
+void TaskPool::execute(Task *task)
+{
+	try
+	{
+		task->run();
+	}
+	catch (std::exception &e)
+	{
+		ofLogError("ofxAlembic::TaskPool") << e.what();
+	}
+	catch (...)
+	{
+		ofLogError("ofxAlembic::TaskPool") << "unknown exception in task";
+	}
+
+	ofScopedLock lock(mutex);
+	if (--(*task->pending) == 0)
+		done_condition.broadcast();
+}
+
+void TaskPool::Worker::threadedFunction()
+{
+	while (isThreadRunning())
+	{
+		Task *task = pool->pop(index);
+		if (!task) task = pool->steal(index);
+
+		if (task)
+		{
+			pool->execute(task);
+			continue;
+		}
+
+		pool->mutex.lock();
+		while (isThreadRunning() && !pool->hasQueued())
+			pool->work_condition.wait(pool->mutex);
+		pool->mutex.unlock();
+	}
+}
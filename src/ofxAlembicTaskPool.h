@@ -0,0 +1,73 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include "Poco/Condition.h"
+
+#include <deque>
+
+namespace ofxAlembic
+{
+class TaskPool;
+}
+
+// fixed set of worker threads with one task deque each.
+// idle workers steal from the other deques, the thread calling run() helps until all tasks are done.
+// run() may be called from several threads at once and from inside a running task.
+
+class ofxAlembic::TaskPool
+{
+public:
+
+	class Task
+	{
+		friend class TaskPool;
+
+	public:
+		Task() : pending(NULL) {}
+		virtual ~Task() {}
+		virtual void run() = 0;
+
+	private:
+		int *pending; // counter of the run() call this task was queued by
+	};
+
+	TaskPool();
+	~TaskPool();
+
+	void setup(int num_threads);
+	void clear();
+
+	inline int getNumThreads() const { return workers.size(); }
+
+	// blocks until every task has run
+	void run(const vector<Task*>& tasks);
+	void run(Task* const *tasks, size_t num_tasks);
+
+protected:
+
+	class Worker : public ofThread
+	{
+	public:
+		TaskPool *pool;
+		int index;
+
+		std::deque<Task*> queue;
+		ofMutex queue_mutex;
+
+	protected:
+		void threadedFunction();
+	};
+
+	vector<Worker*> workers;
+
+	ofMutex mutex;
+	Poco::Condition work_condition;
+	Poco::Condition done_condition;
+
+	Task* pop(int index);
+	Task* steal(int thief);
+	bool hasQueued();
+
+	void execute(Task *task);
+};
@@ -0,0 +1,154 @@
+#include "ofxAlembicTrace.h"
+
+#include "Poco/Thread.h"
+#include "Poco/AtomicCounter.h"
+
+#include <set>
+
+struct TraceEvent
+{
+	const char *name;
+	string detail;
+	unsigned long long start;
+	unsigned long long duration;
+	int thread;
+};
+
+// written under trace_mutex, read without it by isTraceEnabled()
+static Poco::AtomicCounter trace_enabled;
+static vector<TraceEvent> trace_events;
+static size_t trace_next = 0;
+static size_t trace_count = 0;
+static ofMutex trace_mutex;
+
+// the main thread is 0, ofThread workers use their Poco thread id
+static int getTraceThread()
+{
+	Poco::Thread *thread = Poco::Thread::current();
+	return thread ? thread->id() : 0;
+}
+
+static void appendEscaped(ostream& o, const string& s)
+{
+	for (size_t i = 0; i < s.size(); i++)
+	{
+		const char c = s[i];
+
+		if (c == '"' || c == '\\') o << '\\' << c;
+		else if ((unsigned char)c < 0x20) o << ' ';
+		else o << c;
+	}
+}
+
+void ofxAlembic::enableTrace(size_t capacity)
+{
+	ofScopedLock lock(trace_mutex);
+
+	if (capacity < 1) capacity = 1;
+
+	trace_events.resize(capacity);
+	trace_next = 0;
+	trace_count = 0;
+	trace_enabled = 1;
+}
+
+void ofxAlembic::disableTrace()
+{
+	// the events stay around for dumpTrace()
+	ofScopedLock lock(trace_mutex);
+	trace_enabled = 0;
+}
+
+bool ofxAlembic::isTraceEnabled()
+{
+	return trace_enabled.value() != 0;
+}
+
+void ofxAlembic::clearTrace()
+{
+	ofScopedLock lock(trace_mutex);
+	trace_next = 0;
+	trace_count = 0;
+}
+
+size_t ofxAlembic::getNumTraceEvents()
+{
+	ofScopedLock lock(trace_mutex);
+	return trace_count;
+}
+
+void ofxAlembic::addTraceEvent(const char *name, const string& detail, unsigned long long start, unsigned long long duration)
+{
+	const int thread = getTraceThread();
+
+	ofScopedLock lock(trace_mutex);
+
+	if (trace_enabled.value() == 0 || trace_events.empty()) return;
+
+	// the oldest event is overwritten, its string keeps the capacity
+	TraceEvent &e = trace_events[trace_next];
+	e.name = name;
+	e.detail = detail;
+	e.start = start;
+	e.duration = duration;
+	e.thread = thread;
+
+	trace_next = (trace_next + 1) % trace_events.size();
+	if (trace_count < trace_events.size()) trace_count++;
+}
+
+string ofxAlembic::getTraceJson()
+{
+	ofScopedLock lock(trace_mutex);
+
+	ostringstream o;
+	o << "{\"traceEvents\": [";
+
+	const size_t first = (trace_next + trace_events.size() - trace_count) % MAX(trace_events.size(), (size_t)1);
+	set<int> threads;
+
+	for (size_t n = 0; n < trace_count; n++)
+	{
+		const TraceEvent &e = trace_events[(first + n) % trace_events.size()];
+		threads.insert(e.thread);
+
+		if (n) o << ",";
+		o << "\n{\"name\": \"" << e.name << "\", \"cat\": \"ofxAlembic\", \"ph\": \"X\""
+		<< ", \"ts\": " << e.start << ", \"dur\": " << e.duration
+		<< ", \"pid\": 0, \"tid\": " << e.thread;
+
+		if (!e.detail.empty())
+		{
+			o << ", \"args\": {\"detail\": \"";
+			appendEscaped(o, e.detail);
+			o << "\"}";
+		}
+
+		o << "}";
+	}
+
+	set<int>::iterator it = threads.begin();
+	while (it != threads.end())
+	{
+		o << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " << *it
+		<< ", \"args\": {\"name\": \"" << (*it == 0 ? "main" : "worker " + ofToString(*it)) << "\"}}";
+		it++;
+	}
+
+	o << "\n], \"displayTimeUnit\": \"ms\"}\n";
+	return o.str();
+}
+
+bool ofxAlembic::dumpTrace(const string& path)
+{
+	ofstream ofs(ofToDataPath(path).c_str(), ios::out | ios::binary);
+
+	if (!ofs)
+	{
+		ofLogError("ofxAlembic") << "can't write trace: " << path;
+		return false;
+	}
+
+	ofs << getTraceJson();
+	return ofs.good();
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "ofMain.h"
+
+// scoped trace events of reader and writer activity, kept in a ring buffer and dumped as
+// Chrome trace JSON (chrome://tracing, ui.perfetto.dev). compiled out with OFX_ALEMBIC_NO_STATS.
+
+namespace ofxAlembic
+{
+class TraceScope;
+
+// starts recording, the buffer keeps the last `capacity` events
+void enableTrace(size_t capacity = 65536);
+void disableTrace();
+// lock free, called from every trace scope on every thread
+bool isTraceEnabled();
+void clearTrace();
+
+size_t getNumTraceEvents();
+
+string getTraceJson();
+bool dumpTrace(const string& path);
+
+// `name` has to outlive the buffer (a string literal), `detail` is copied
+void addTraceEvent(const char *name, const string& detail, unsigned long long start, unsigned long long duration);
+}
+
+class ofxAlembic::TraceScope
+{
+public:
+
+	// `active` is passed in so the flag is read once per scope
+	TraceScope(const char *name, bool active) : name(name), active(active)
+	{
+		if (active) start = ofGetElapsedTimeMicros();
+	}
+
+	~TraceScope()
+	{
+		if (active) addTraceEvent(name, detail, start, ofGetElapsedTimeMicros() - start);
+	}
+
+	inline bool isActive() const { return active; }
+	inline void setDetail(const string& d) { detail = d; }
+
+private:
+
+	const char *name;
+	string detail;
+	bool active;
+	unsigned long long start;
+
+	TraceScope(const TraceScope&);
+	TraceScope& operator=(const TraceScope&);
+};
+
+// traces the rest of the enclosing scope, `detail` is only evaluated while tracing
+#ifdef OFX_ALEMBIC_NO_STATS
+#define OFX_ALEMBIC_TRACE(name, detail)
+#else
+#define OFX_ALEMBIC_TRACE(name, detail) ofxAlembic::TraceScope ofx_alembic_trace((name), ofxAlembic::isTraceEnabled()); if (ofx_alembic_trace.isActive()) ofx_alembic_trace.setDetail(detail)
+#endif
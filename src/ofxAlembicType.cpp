@@ -1,4 +1,5 @@
 #include "ofxAlembicType.h"
+#include "ofxAlembicTaskPool.h"
 
 
 #if (_MSC_VER)
@@ -9,68 +10,272 @@
 using namespace ofxAlembic;
 using namespace Alembic::AbcGeom;
 
+// element-wise comparison of a sample with the one a view holds
+template <typename T>
+static bool isSameArray(const Alembic::Util::shared_ptr<T> &sample, const ArrayView<T> &view)
+{
+	const size_t size = sample ? sample->size() : 0;
+
+	if (size != view.size()) return false;
+	return size == 0 || memcmp(sample->get(), view.data(), size * sizeof(typename T::value_type)) == 0;
+}
+
 #pragma mark - Points
 
-Points::Points(const vector<ofVec3f>& ofpoints)
+Points::Points(const vector<Point>& points)
 {
-	for (int i = 0; i < ofpoints.size(); i++)
+	positions.resize(points.size());
+	ids.resize(points.size());
+
+	for (int i = 0; i < points.size(); i++)
 	{
-		points.push_back(ofpoints[i]);
+		positions[i] = points[i].pos;
+		ids[i] = points[i].id;
 	}
 }
 
-void Points::get(OPointsSchema &schema) const
+void Points::clear()
+{
+	positions.clear();
+	ids.clear();
+	velocities.clear();
+	widths.clear();
+}
+
+void Points::getPoints(vector<Point>& points) const
+{
+	const size_t num = positions.size();
+	const bool has_ids = ids.size() == num;
+
+	points.resize(num);
+
+	for (size_t i = 0; i < num; i++)
+		points[i] = has_ids ? Point(ids[i], positions[i]) : Point(positions[i]);
+}
+
+void Points::swap(Points &other)
+{
+	positions.swap(other.positions);
+	ids.swap(other.ids);
+	velocities.swap(other.velocities);
+	widths.swap(other.widths);
+}
+
+void Points::get(OPointsSchema &schema, Stats *stats) const
 {
-	int num = points.size();
+	const size_t num = positions.size();
 
-	vector<V3f> positions(num);
-	vector<::uint64_t> ids(num);
+	// ofVec3f and V3f are both three packed floats, positions and velocities go out without a copy
+	const V3f *p = num ? (const V3f*)positions[0].getPtr() : NULL;
 
-	for (int i = 0; i < num; i++)
+	vector<::uint64_t> unset;
+	const ::uint64_t *id = ids.size() == num && num ? (const ::uint64_t*)&ids[0] : NULL;
+
+	// points without ids keep the id of a default constructed Point
+	if (id == NULL)
 	{
-		positions[i] = toAbc(points[i].pos);
-		ids[i] = points[i].id;
+		OFX_ALEMBIC_TIMER(stats, PHASE_CONVERT);
+
+		unset.assign(num, Point().id);
+		id = num ? &unset[0] : NULL;
+	}
+
+	OFX_ALEMBIC_TIMER(stats, PHASE_WRITE);
+
+	OPointsSchema::Sample sample(P3fArraySample(p, num), UInt64ArraySample(id, num));
+
+	if (velocities.size() == num && num)
+		sample.setVelocities(V3fArraySample((const V3f*)velocities[0].getPtr(), num));
+
+	OFloatGeomParam::Sample width_sample;
+
+	if (!widths.empty() && (widths.size() == num || widths.size() == 1))
+	{
+		width_sample.setScope(widths.size() == 1 ? kConstantScope : kVertexScope);
+		width_sample.setVals(FloatArraySample(&widths[0], widths.size()));
+		sample.setWidths(width_sample);
 	}
 
-	OPointsSchema::Sample sample((P3fArraySample(positions)),
-								 UInt64ArraySample(ids));
 	schema.set(sample);
 }
 
 void Points::set(IPointsSchema &schema, float time, const Imath::M44f& transform)
 {
-	ISampleSelector ss(time, ISampleSelector::kNearIndex);
-	IPointsSchema::Sample sample;
-	schema.get(sample, ss);
+	set(schema, ISampleSelector(time, ISampleSelector::kNearIndex), transform, NULL);
+}
 
-	P3fArraySamplePtr m_positions = sample.getPositions();
+void Points::set(IPointsSchema &schema, const ISampleSelector &ss, const Imath::M44f& transform, PointsView *view, Stats *stats, unsigned int attributes)
+{
+	P3fArraySamplePtr m_positions;
+	UInt64ArraySamplePtr id_ptr;
+	V3fArraySamplePtr velocity_ptr;
+	FloatArraySamplePtr width_ptr;
+
+	// property by property, attributes that are masked out are never fetched
+	{
+		OFX_ALEMBIC_TIMER(stats, PHASE_READ);
+		ArchiveLock lock;
+
+		schema.getPositionsProperty().get(m_positions, ss);
+
+		IUInt64ArrayProperty I = schema.getIdsProperty();
+		if ((attributes & ATTRIBUTE_IDS) && I.valid())
+			I.get(id_ptr, ss);
+
+		IV3fArrayProperty V = schema.getVelocitiesProperty();
+		if ((attributes & ATTRIBUTE_VELOCITIES) && V.valid())
+			V.get(velocity_ptr, ss);
 
-	size_t num_points = m_positions->size();
-	const V3f *src = m_positions->get();
-	V3f dst;
+		IFloatGeomParam W = schema.getWidthsParam();
+		if ((attributes & ATTRIBUTE_WIDTHS) && W.valid())
+			width_ptr = W.getExpandedValue(ss).getVals();
+	}
+
+	if (!m_positions) return;
+
+	if (view)
+	{
+		view->positions = m_positions;
+		view->ids = id_ptr;
+		view->velocities = velocity_ptr;
+		view->widths = width_ptr;
+		view->transform = transform;
+	}
 
-	points.resize(num_points);
+	const size_t num_points = m_positions->size();
 
-	for (int i = 0; i < num_points; i++)
 	{
-		transform.multVecMatrix(src[i], dst);
-		points[i] = toOf(dst);
+		OFX_ALEMBIC_TIMER(stats, PHASE_BUILD);
+
+		const size_t num_ids = id_ptr && id_ptr->size() == num_points ? num_points : 0;
+		resizeBuffer(ids, num_ids);
+		if (num_ids)
+			memcpy(&ids[0], id_ptr->get(), num_ids * sizeof(uint64_t));
+
+		const size_t num_widths = width_ptr ? width_ptr->size() : 0;
+		resizeBuffer(widths, num_widths);
+		if (num_widths)
+			memcpy(&widths[0], width_ptr->get(), num_widths * sizeof(float));
 	}
+
+	OFX_ALEMBIC_TIMER(stats, PHASE_TRANSFORM);
+
+	resizeBuffer(positions, num_points);
+
+	if (num_points)
+		transformPoints(transform.getValue(), m_positions->get()->getValue(), positions[0].getPtr(), num_points);
+
+	const size_t num_velocities = velocity_ptr && velocity_ptr->size() == num_points ? num_points : 0;
+	resizeBuffer(velocities, num_velocities);
+
+	if (num_velocities)
+		transformDirections(transform.getValue(), velocity_ptr->get()->getValue(), velocities[0].getPtr(), num_velocities);
 }
 
-void Points::draw()
+void Points::readBlend(IPointsSchema &schema, const ISampleSelector &ss, const PointsView &view, SampleBlend &target, Stats *stats)
 {
-	glBegin(GL_POINTS);
-	for (int i = 0; i < points.size(); i++)
+	P3fArraySamplePtr positions;
+	UInt64ArraySamplePtr id_ptr;
+
 	{
-		glVertex3fv(points[i].pos.getPtr());
+		OFX_ALEMBIC_TIMER(stats, PHASE_READ);
+		ArchiveLock lock;
+
+		schema.getPositionsProperty().get(positions, ss);
+
+		// without ids on both sides points are matched by their order
+		IUInt64ArrayProperty I = schema.getIdsProperty();
+		if (!view.ids.empty() && I.valid())
+			I.get(id_ptr, ss);
 	}
-	glEnd();
+
+	target.positions = positions;
+	target.normals.reset();
+	target.matches = positions && positions->size() == view.positions.size()
+		&& (!id_ptr || isSameArray(id_ptr, view.ids));
+}
+
+void Points::blend(const PointsView &view, const SampleBlend &target, float alpha, const Imath::M44f& transform, Stats *stats)
+{
+	const size_t num_points = view.positions.size();
+	if (num_points == 0 || num_points != target.positions.size()) return;
+
+	OFX_ALEMBIC_TIMER(stats, PHASE_INTERPOLATE);
+
+	resizeBuffer(positions, num_points);
+	lerpFloats(view.positions.data()->getValue(), target.positions.data()->getValue(), positions[0].getPtr(), num_points * 3, alpha);
+	transformPoints(transform.getValue(), positions[0].getPtr(), positions[0].getPtr(), num_points);
+}
+
+size_t Points::getMemoryUsage() const
+{
+	return getBufferSize(positions)
+		+ getBufferSize(ids)
+		+ getBufferSize(velocities)
+		+ getBufferSize(widths);
+}
+
+void Points::release()
+{
+	freeBuffer(positions);
+	freeBuffer(ids);
+	freeBuffer(velocities);
+	freeBuffer(widths);
 }
 
 #pragma mark - PolyMesh
 
+// FNV-1a over 64 bit words instead of bytes, with a shift folding the high bits back in.
+// only compared against digests of the same process, so it does not need to match any reference.
+
+static const Alembic::Util::uint64_t digest_basis = 14695981039346656037ULL;
+
+static inline Alembic::Util::uint64_t digest(Alembic::Util::uint64_t h, Alembic::Util::uint64_t v)
+{
+	h ^= v;
+	h *= 1099511628211ULL;
+	return h ^ (h >> 32);
+}
+
+static Alembic::Util::uint64_t digest(Alembic::Util::uint64_t h, const void *data, size_t bytes)
+{
+	const char *p = (const char*)data;
+	const size_t num_words = bytes / 8;
+
+	for (size_t i = 0; i < num_words; i++)
+	{
+		Alembic::Util::uint64_t v;
+		memcpy(&v, p + i * 8, 8);
+		h = digest(h, v);
+	}
+
+	if (bytes % 8)
+	{
+		Alembic::Util::uint64_t v = 0;
+		memcpy(&v, p + num_words * 8, bytes % 8);
+		h = digest(h, v);
+	}
+
+	return digest(h, bytes);
+}
+
 void PolyMesh::get(OPolyMeshSchema &schema) const
+{
+	get(schema, true);
+}
+
+Alembic::Util::uint64_t PolyMesh::getTopologyDigest() const
+{
+	Alembic::Util::uint64_t h = digest(digest_basis, mesh.getNumVertices());
+
+	const vector<ofIndexType>& idx = mesh.getIndices();
+	if (!idx.empty())
+		h = digest(h, &idx[0], idx.size() * sizeof(ofIndexType));
+
+	return h;
+}
+
+void PolyMesh::get(OPolyMeshSchema &schema, bool with_topology, Stats *stats) const
 {
 	vector<V3f> positions;
 	vector <::int32_t> indexes;
@@ -81,50 +286,54 @@ void PolyMesh::get(OPolyMeshSchema &schema) const
 	OV2fGeomParam::Sample uv_sample;
 	ON3fGeomParam::Sample norm_sample;
 
+	OFX_ALEMBIC_TIMER(stats, PHASE_CONVERT);
+
 	if (mesh.getNumIndices())
 	{
-		const int num_samples = mesh.getNumIndices();
+		// shared vertices go out as positions, the ofMesh indices as face indices
+		const int num_indices = mesh.getNumIndices();
+		const int num_verts = mesh.getNumVertices();
 
 		const vector<ofIndexType>& idx = mesh.getIndices();
 
+		if (with_topology)
 		{
-			indexes.resize(num_samples);
-			for (int i = 0; i < num_samples; i++)
-				indexes[i] = i;
+			indexes.resize(num_indices);
+			for (int i = 0; i < num_indices; i++)
+				indexes[i] = idx[i];
 		}
 
 		{
 			const vector<ofVec3f>& verts = mesh.getVertices();
-			positions.resize(num_samples);
+			positions.resize(num_verts);
 
-			for (int i = 0; i < num_samples; i++)
-				positions[i] = toAbc(verts[idx[i]]);
+			for (int i = 0; i < num_verts; i++)
+				positions[i] = toAbc(verts[i]);
 		}
 
-		if (mesh.getNumTexCoords() == mesh.getNumVertices())
+		if (mesh.getNumTexCoords() == num_verts)
 		{
 			const vector<ofVec2f> &v = mesh.getTexCoords();
 
-			uvs.resize(num_samples);
-			for (int i = 0; i < num_samples; i++)
-				uvs[i] = toAbc(v[idx[i]]);
+			uvs.resize(num_verts);
+			for (int i = 0; i < num_verts; i++)
+				uvs[i] = toAbc(v[i]);
 		}
-		assert(uvs.size() == 0 || uvs.size() == num_samples);
 
-		if (mesh.getNumNormals() == mesh.getNumVertices())
+		if (mesh.getNumNormals() == num_verts)
 		{
 			const vector<ofVec3f> &v = mesh.getNormals();
 
-			norms.resize(num_samples);
-			for (int i = 0; i < num_samples; i++)
-				norms[i] = toAbc(v[idx[i]].getNormalized() * -1);
+			norms.resize(num_verts);
+			for (int i = 0; i < num_verts; i++)
+				norms[i] = toAbc(v[i].getNormalized() * -1);
 		}
-		assert(norms.size() == 0 || norms.size() == num_samples);
 	}
 	else
 	{
 		const int num_samples = mesh.getNumVertices();
 
+		if (with_topology)
 		{
 			indexes.resize(num_samples);
 			for (int i = 0; i < num_samples; i++)
@@ -161,8 +370,10 @@ void PolyMesh::get(OPolyMeshSchema &schema) const
 	}
 
 	// supports only triangles
+	if (with_topology)
 	{
 		int num_tris = indexes.size() / 3;
+		indexes.resize(num_tris * 3);
 		counts.resize(num_tris);
 		for (int i = 0; i < num_tris; i++)
 			counts[i] = 3;
@@ -180,9 +391,13 @@ void PolyMesh::get(OPolyMeshSchema &schema) const
 		norm_sample.setVals(N3fArraySample(norms));
 	}
 
+	OFX_ALEMBIC_TIMER_STOP(PHASE_CONVERT);
+	OFX_ALEMBIC_TIMER(stats, PHASE_WRITE);
+
+	// a default constructed (NULL) array sample repeats the previous one, an empty vector would write an empty one
 	OPolyMeshSchema::Sample sample((P3fArraySample(positions)),
-								   Int32ArraySample(indexes),
-								   Int32ArraySample(counts),
+								   with_topology ? Int32ArraySample(indexes) : Int32ArraySample(),
+								   with_topology ? Int32ArraySample(counts) : Int32ArraySample(),
 								   uv_sample,
 								   norm_sample);
 	schema.set(sample);
@@ -190,237 +405,1273 @@ void PolyMesh::get(OPolyMeshSchema &schema) const
 
 void PolyMesh::set(IPolyMeshSchema &schema, float time, const Imath::M44f& transform)
 {
-	ISampleSelector ss(time, ISampleSelector::kNearIndex);
-	IPolyMeshSchema::Sample sample;
-	schema.get(sample, ss);
-
-	P3fArraySamplePtr m_meshP = sample.getPositions();
-	Int32ArraySamplePtr m_meshIndices = sample.getFaceIndices();
-	Int32ArraySamplePtr m_meshCounts = sample.getFaceCounts();
+	set(schema, ISampleSelector(time, ISampleSelector::kNearIndex), transform);
+}
 
-	mesh.clear();
+void PolyMesh::set(IPolyMeshSchema &schema, const ISampleSelector &ss, const Imath::M44f& transform)
+{
+	set(schema, ss, transform, NULL);
+}
 
-	size_t numFaces = m_meshCounts->size();
-	size_t numIndices = m_meshIndices->size();
-	size_t numPoints = m_meshP->size();
-	if (numFaces < 1 ||
-		numIndices < 1 ||
-		numPoints < 1)
+void PolyMesh::set(IPolyMeshSchema &schema, const ISampleSelector &ss, const Imath::M44f& transform, PolyMeshTopology *topology, PolyMeshView *view, Stats *stats, unsigned int attributes)
+{
+	PolyMeshTopology local_topology;
+	if (topology == NULL) topology = &local_topology;
+
+	P3fArraySamplePtr m_meshP;
+	Int32ArraySamplePtr m_meshIndices;
+	Int32ArraySamplePtr m_meshCounts;
+	N3fArraySamplePtr norm_ptr;
+	V2fArraySamplePtr uv_ptr;
+	UInt32ArraySamplePtr norm_indices;
+	UInt32ArraySamplePtr uv_indices;
+
+	GeometryScope norm_scope = kUnknownScope;
+	GeometryScope uv_scope = kUnknownScope;
+
+	bool norm_indexed = false;
+	bool uv_indexed = false;
+	bool norm_constant = false;
+	bool uv_constant = false;
+	bool generate_normals = false;
+
+	// with a valid topology only the positions have to be streamed
+	bool reuse = topology->valid
+		&& mesh.getNumVertices() == topology->points.size()
+		&& mesh.getNumIndices() == topology->indices.size();
+
+	// everything touching the archive happens in here, conversion runs unlocked
 	{
-		return;
-	}
+		OFX_ALEMBIC_TIMER(stats, PHASE_READ);
+		ArchiveLock lock;
 
-	// TODO: organaize face index
-	// make Triangle and Quad class
+		IN3fGeomParam N = schema.getNormalsParam();
+		IV2fGeomParam UV = schema.getUVsParam();
 
-	typedef Imath::Vec3<unsigned int> Tri;
-	typedef std::vector<Tri> TriArray;
+		if (!(attributes & ATTRIBUTE_NORMALS)) N.reset();
+		if (!(attributes & ATTRIBUTE_UVS)) UV.reset();
 
-	TriArray m_triangles;
+		generate_normals = topology->normal_mode != NORMAL_NONE && (attributes & ATTRIBUTE_NORMALS) && !N.valid();
 
-	size_t faceIndexBegin = 0;
-	size_t faceIndexEnd = 0;
-	for (size_t face = 0; face < numFaces; ++face)
-	{
-		faceIndexBegin = faceIndexEnd;
-		size_t count = (*m_meshCounts)[face];
-		faceIndexEnd = faceIndexBegin + count;
+		norm_indexed = N.valid() && N.isIndexed();
+		uv_indexed = UV.valid() && UV.isIndexed();
 
-		// Check this face is valid
-		if (faceIndexEnd > numIndices ||
-			faceIndexEnd < faceIndexBegin)
+		const bool norm_indices_constant = !norm_indexed || N.getIndexProperty().isConstant();
+		const bool uv_indices_constant = !uv_indexed || UV.getIndexProperty().isConstant();
+
+		// values that never change can decide the weld for good, animated ones are checked per sample
+		norm_constant = N.valid() && N.isConstant() && norm_indices_constant;
+		uv_constant = UV.valid() && UV.isConstant() && uv_indices_constant;
+
+		// animated index arrays change which values the welded vertices share
+		if (topology->indexed && !(norm_indices_constant && uv_indices_constant))
+			reuse = false;
+
+		if (reuse)
 		{
-			ofLogError("ofxAlembic") << "Mesh update quitting on face: "
-			<< face
-			<< " because of wonky numbers"
-			<< ", faceIndexBegin = " << faceIndexBegin
-			<< ", faceIndexEnd = " << faceIndexEnd
-			<< ", numIndices = " << numIndices
-			<< ", count = " << count;
+			schema.getPositionsProperty().get(m_meshP, ss);
+			reuse = m_meshP && m_meshP->size() == topology->num_points;
+		}
 
-			// Just get out, make no more triangles.
-			break;
+		if (!reuse)
+		{
+			IPolyMeshSchema::Sample sample;
+			schema.get(sample, ss);
+
+			m_meshP = sample.getPositions();
+			m_meshIndices = sample.getFaceIndices();
+			m_meshCounts = sample.getFaceCounts();
 		}
 
-		// Make triangles to fill this face.
-		if (count >= 3)
+		// constant attributes stay in the mesh as long as the topology is reused,
+		// values and indices are read as they are and resolved through the topology's maps
+		if (N.valid()
+			&& (!reuse
+				|| !N.isConstant()
+				|| topology->transform != transform
+				|| mesh.getNumNormals() != topology->points.size()))
 		{
-			m_triangles.push_back(Tri((unsigned int)faceIndexBegin + 0,
-									  (unsigned int)faceIndexBegin + 1,
-									  (unsigned int)faceIndexBegin + 2));
-			for (size_t c = 3; c < count; ++c)
-			{
-				m_triangles.push_back(Tri((unsigned int)faceIndexBegin + 0,
-										  (unsigned int)faceIndexBegin + c - 1,
-										  (unsigned int)faceIndexBegin + c));
-			}
+			N.getValueProperty().get(norm_ptr, ss);
+			norm_scope = N.getScope();
+
+			if (norm_indexed
+				&& (!reuse
+					|| !norm_indices_constant
+					|| topology->norm_map.size() != topology->points.size()
+					|| topology->num_norm_values != norm_ptr->size()))
+				N.getIndexProperty().get(norm_indices, ss);
+		}
+
+		if (UV.valid()
+			&& (!reuse
+				|| !UV.isConstant()
+				|| mesh.getNumTexCoords() != topology->points.size()))
+		{
+			UV.getValueProperty().get(uv_ptr, ss);
+			uv_scope = UV.getScope();
+
+			if (uv_indexed
+				&& (!reuse
+					|| !uv_indices_constant
+					|| topology->uv_map.size() != topology->points.size()
+					|| topology->num_uv_values != uv_ptr->size()))
+				UV.getIndexProperty().get(uv_indices, ss);
 		}
 	}
 
+	// animated values merged by the weld because they were equal split apart again, weld anew
+	if (reuse && topology->indexed && !topology->isWeldValid(uv_ptr, norm_ptr))
 	{
-		const V3f *points = m_meshP->get();
-		const ::int32_t *indices = m_meshIndices->get();
+		OFX_ALEMBIC_TIMER(stats, PHASE_READ);
+		ArchiveLock lock;
+
+		IPolyMeshSchema::Sample sample;
+		schema.get(sample, ss);
 
-		V3f dst;
-		vector<ofVec3f> verts;
+		m_meshP = sample.getPositions();
+		m_meshIndices = sample.getFaceIndices();
+		m_meshCounts = sample.getFaceCounts();
+
+		// a new weld needs every attribute, also those kept from the last sample
+		IN3fGeomParam N = schema.getNormalsParam();
+		IV2fGeomParam UV = schema.getUVsParam();
 
-		for (int i = 0; i < numPoints; i++)
+		if (N.valid() && (attributes & ATTRIBUTE_NORMALS))
 		{
-			transform.multVecMatrix(points[i], dst);
-			verts.push_back(ofVec3f(dst[0], dst[1], dst[2]));
+			if (!norm_ptr) N.getValueProperty().get(norm_ptr, ss);
+			if (norm_indexed && !norm_indices) N.getIndexProperty().get(norm_indices, ss);
+			norm_scope = N.getScope();
 		}
 
-		for (int i = 0; i < m_triangles.size(); i++)
+		if (UV.valid() && (attributes & ATTRIBUTE_UVS))
 		{
-			Tri &t = m_triangles[i];
-			mesh.addVertex(verts[indices[t[0]]]);
-			mesh.addVertex(verts[indices[t[1]]]);
-			mesh.addVertex(verts[indices[t[2]]]);
+			if (!uv_ptr) UV.getValueProperty().get(uv_ptr, ss);
+			if (uv_indexed && !uv_indices) UV.getIndexProperty().get(uv_indices, ss);
+			uv_scope = UV.getScope();
 		}
+
+		reuse = false;
 	}
 
+	if (!reuse)
 	{
-		IN3fGeomParam N = schema.getNormalsParam();
-		if (N.valid())
+		OFX_ALEMBIC_TIMER(stats, PHASE_TRIANGULATE);
+
+		mesh.clear();
+
+		if (view)
 		{
-			if (N.isIndexed())
-			{
-				ofLogError("ofxAlembic::PolyMesh") << "indexed normal is not supported";
-			}
-			else
-			{
-				N3fArraySamplePtr norm_ptr = N.getExpandedValue(ss).getVals();
-				N3f norm;
-				vector<ofVec3f> norms;
+			view->face_indices = m_meshIndices;
+			view->face_counts = m_meshCounts;
+		}
 
-				for (int i = 0; i < norm_ptr->size(); i++)
-				{
-					transform.multDirMatrix(((*norm_ptr)[i]), norm);
-					norms.push_back(toOf(norm));
-				}
+		if (!topology->build(*m_meshCounts, *m_meshIndices, m_meshP->size()))
+			return;
 
-				for (int i = 0; i < m_triangles.size(); i++)
-				{
-					Tri &t = m_triangles[i];
-					mesh.addNormal(norms[t[0]]);
-					mesh.addNormal(norms[t[1]]);
-					mesh.addNormal(norms[t[2]]);
-				}
-			}
+		if (topology->indexed)
+		{
+			if (uv_ptr) topology->mapAttribute(uv_scope, uv_ptr->size(), uv_indices, topology->uv_map);
+			if (norm_ptr) topology->mapAttribute(norm_scope, norm_ptr->size(), norm_indices, topology->norm_map);
+
+			topology->weld(uv_ptr, norm_ptr, generate_normals && topology->normal_mode == NORMAL_FLAT);
+
+			// constant values stay equal, only animated merges are checked on later samples
+			if (uv_constant) freeBuffer(topology->uv_weld_pairs);
+			if (norm_constant) freeBuffer(topology->norm_weld_pairs);
+
+			vector<ofIndexType> &indices = mesh.getIndices();
+			resizeBuffer(indices, topology->indices.size());
+			std::copy(topology->indices.begin(), topology->indices.end(), indices.begin());
+
+			// the maps were per triangle vertex, make them per welded vertex
+			topology->uv_map.clear();
+			topology->norm_map.clear();
 		}
+
+		resizeBuffer(mesh.getVertices(), topology->points.size());
 	}
 
+	// attributes masked out since the last sample
+	if (!(attributes & ATTRIBUTE_NORMALS) && !mesh.getNormals().empty())
+		freeBuffer(mesh.getNormals());
+
+	if (!(attributes & ATTRIBUTE_UVS) && !mesh.getTexCoords().empty())
+		freeBuffer(mesh.getTexCoords());
+
+	if (view)
 	{
-		IV2fGeomParam UV = schema.getUVsParam();
-		if (UV.valid())
+		view->positions = m_meshP;
+		view->transform = transform;
+
+		if (!(attributes & ATTRIBUTE_NORMALS))
 		{
-			if (UV.isIndexed())
-			{
-				ofLogError("ofxAlembic::PolyMesh") << "indexed uv is not supported";
-			}
-			else
+			view->normals.reset();
+			view->normal_indices.reset();
+		}
+
+		if (!(attributes & ATTRIBUTE_UVS))
+		{
+			view->uvs.reset();
+			view->uv_indices.reset();
+		}
+	}
+
+	const size_t num_verts = topology->points.size();
+
+	if (num_verts)
+	{
+		const V3f *points = m_meshP->get();
+		const ::int32_t *indices = &topology->points[0];
+		vector<ofVec3f>& verts = mesh.getVertices();
+
+		{
+			OFX_ALEMBIC_TIMER(stats, PHASE_BUILD);
+
+			for (size_t i = 0; i < num_verts; i++)
+				verts[i] = toOf(points[indices[i]]);
+		}
+
+		OFX_ALEMBIC_TIMER(stats, PHASE_TRANSFORM);
+		transformPoints(transform.getValue(), verts[0].getPtr(), verts[0].getPtr(), num_verts);
+	}
+
+	// from the final positions, so the transform is already in
+	if (generate_normals)
+	{
+		OFX_ALEMBIC_TIMER(stats, PHASE_NORMALS);
+		topology->generateNormals(mesh.getVertices(), mesh.getNormals());
+	}
+
+	if (norm_ptr)
+	{
+		if (view)
+		{
+			view->normals = norm_ptr;
+			view->normals_scope = norm_scope;
+			if (!norm_indexed) view->normal_indices.reset();
+			else if (norm_indices) view->normal_indices = norm_indices;
+		}
+
+		// the map is resolved once per topology, or again when the indices or the value count moved
+		if (norm_indices
+			|| topology->norm_map.size() != num_verts
+			|| topology->num_norm_values != norm_ptr->size())
+		{
+			topology->mapAttribute(norm_scope, norm_ptr->size(), norm_indices, topology->norm_map);
+			topology->num_norm_values = norm_ptr->size();
+		}
+
+		if (num_verts && topology->norm_map.size() == num_verts)
+		{
+			const ::int32_t *index = &topology->norm_map[0];
+			const N3f *src = norm_ptr->get();
+
+			vector<ofVec3f>& norms = mesh.getNormals();
+			resizeBuffer(norms, num_verts);
+
 			{
-				V2fArraySamplePtr uv_ptr = UV.getExpandedValue(ss).getVals();
+				OFX_ALEMBIC_TIMER(stats, PHASE_BUILD);
 
-				for (int i = 0; i < m_triangles.size(); i++)
-				{
-					Tri &t = m_triangles[i];
-					mesh.addTexCoord(toOf((*uv_ptr)[t[0]]));
-					mesh.addTexCoord(toOf((*uv_ptr)[t[1]]));
-					mesh.addTexCoord(toOf((*uv_ptr)[t[2]]));
-				}
+				for (size_t i = 0; i < num_verts; i++)
+					norms[i] = toOf(src[index[i]]);
 			}
+
+			OFX_ALEMBIC_TIMER(stats, PHASE_TRANSFORM);
+			transformDirections(transform.getValue(), norms[0].getPtr(), norms[0].getPtr(), num_verts);
 		}
 	}
-}
 
-void PolyMesh::draw()
-{
-	//CW: change this
-	/*
-	shader.begin();
-	ofSetColor();
-	*/
-	//ofSetColor( 255, 0, 255);
+	if (uv_ptr)
+	{
+		if (view)
+		{
+			view->uvs = uv_ptr;
+			view->uvs_scope = uv_scope;
+			if (!uv_indexed) view->uv_indices.reset();
+			else if (uv_indices) view->uv_indices = uv_indices;
+		}
 
-	if( ofGetFill() == OF_OUTLINE ){
-		mesh.drawWireframe();
-	}else{
-		mesh.draw();
-	}
-}
+		if (uv_indices
+			|| topology->uv_map.size() != num_verts
+			|| topology->num_uv_values != uv_ptr->size())
+		{
+			topology->mapAttribute(uv_scope, uv_ptr->size(), uv_indices, topology->uv_map);
+			topology->num_uv_values = uv_ptr->size();
+		}
+
+		if (num_verts && topology->uv_map.size() == num_verts)
+		{
+			const ::int32_t *index = &topology->uv_map[0];
+			const V2f *src = uv_ptr->get();
+
+			vector<ofVec2f>& uvs = mesh.getTexCoords();
+			resizeBuffer(uvs, num_verts);
 
-void PolyMesh::drawTextured( ofImage *tex ){
-	tex->getTextureReference().bind();
-	if( ofGetFill() == OF_OUTLINE ){
-		mesh.drawWireframe();
-	}else{
-		mesh.draw();
+			OFX_ALEMBIC_TIMER(stats, PHASE_BUILD);
+
+			for (size_t i = 0; i < num_verts; i++)
+				uvs[i] = toOf(src[index[i]]);
+		}
 	}
-	tex->getTextureReference().unbind();
-}
 
-#pragma mark - Curves
+	topology->transform = transform;
+}
 
-void Curves::get(OCurvesSchema &schema) const
+void PolyMesh::readBlend(IPolyMeshSchema &schema, const ISampleSelector &ss, const PolyMeshView &view, SampleBlend &target, Stats *stats, unsigned int attributes)
 {
-	vector<V3f> positions;
-	vector<::int32_t> num_vertices;
+	P3fArraySamplePtr positions;
+	N3fArraySamplePtr normals;
+	bool matches = false;
 
-	for (int n = 0; n < curves.size(); n++)
 	{
-		const ofPolyline &polyline = curves[n];
+		OFX_ALEMBIC_TIMER(stats, PHASE_READ);
+		ArchiveLock lock;
+
+		schema.getPositionsProperty().get(positions, ss);
+		matches = positions && positions->size() == view.positions.size();
 
-		for (int i = 0; i < polyline.size(); i++)
+		// a homogenous face layout is the same in every sample, a varying one has to be compared
+		if (matches && schema.getTopologyVariance() == kHeterogenousTopology)
 		{
-			positions.push_back(toAbc(polyline[i]));
+			Int32ArraySamplePtr face_indices, face_counts;
+			schema.getFaceIndicesProperty().get(face_indices, ss);
+			schema.getFaceCountsProperty().get(face_counts, ss);
+
+			matches = isSameArray(face_counts, view.face_counts) && isSameArray(face_indices, view.face_indices);
 		}
 
-		num_vertices.push_back(polyline.size());
+		// values are blended one by one, which only works while the index array stays put
+		IN3fGeomParam N = schema.getNormalsParam();
+
+		if (matches && (attributes & ATTRIBUTE_NORMALS) && N.valid() && !N.isConstant()
+			&& (!N.isIndexed() || N.getIndexProperty().isConstant()))
+			N.getValueProperty().get(normals, ss);
 	}
 
-	OCurvesSchema::Sample sample((P3fArraySample(positions)),
-								 Int32ArraySample(num_vertices),
-								 kLinear,
-								 kNonPeriodic);
-	schema.set(sample);
+	target.positions = positions;
+	target.normals = normals;
+	target.matches = matches;
 }
 
-void Curves::set(ICurvesSchema &schema, float time, const Imath::M44f& transform)
+void PolyMesh::blend(const PolyMeshView &view, const SampleBlend &target, float alpha, const Imath::M44f& transform, PolyMeshTopology *topology, Stats *stats, unsigned int attributes)
 {
-	ISampleSelector ss(time, ISampleSelector::kNearIndex);
-	ICurvesSchema::Sample sample;
-	schema.get(sample, ss);
+	const size_t num_verts = topology->points.size();
+	const size_t num_points = view.positions.size();
 
-	P3fArraySamplePtr m_positions = sample.getPositions();
-	std::size_t m_nCurves = sample.getNumCurves();
+	if (num_verts == 0
+		|| num_points != target.positions.size()
+		|| mesh.getNumVertices() != num_verts)
+		return;
+
+	vector<ofVec3f> &mixed = topology->blend_scratch;
+	vector<ofVec3f> &verts = mesh.getVertices();
+
+	{
+		OFX_ALEMBIC_TIMER(stats, PHASE_INTERPOLATE);
+
+		// mix the samples as stored, then expand them per output vertex like set() does
+		resizeBuffer(mixed, num_points);
+		lerpFloats(view.positions.data()->getValue(), target.positions.data()->getValue(), mixed[0].getPtr(), num_points * 3, alpha);
 
-	const V3f *src = m_positions->get();
-	const Alembic::Util::int32_t *nVertices = sample.getCurvesNumVertices()->get();
-	V3f dst;
+		const ::int32_t *index = &topology->points[0];
 
-	curves.resize(m_nCurves);
+		for (size_t i = 0; i < num_verts; i++)
+			verts[i] = mixed[index[i]];
 
-	for (int i = 0; i < m_nCurves; i++)
+		transformPoints(transform.getValue(), verts[0].getPtr(), verts[0].getPtr(), num_verts);
+	}
+
+	const size_t num_norms = view.normals.size();
+
+	// normals the weld merged have to stay equal in the target, otherwise the decoded ones are kept
+	if (num_norms
+		&& num_norms == target.normals.size()
+		&& topology->norm_map.size() == num_verts
+		&& mesh.getNumNormals() == num_verts
+		&& topology->isWeldValid(V2fArraySamplePtr(), target.normals.getSample()))
 	{
-		ofPolyline &polyline = curves[i];
-		const int num = nVertices[i];
+		OFX_ALEMBIC_TIMER(stats, PHASE_INTERPOLATE);
 
-		polyline.clear();
+		resizeBuffer(mixed, num_norms);
+		lerpFloats(view.normals.data()->getValue(), target.normals.data()->getValue(), mixed[0].getPtr(), num_norms * 3, alpha);
+		normalizeDirections(mixed[0].getPtr(), num_norms);
 
-		for (int n = 0; n < num; n++)
-		{
-			transform.multVecMatrix(*src, dst);
-			polyline.addVertex(toOf(dst));
-			src++;
-		}
+		const ::int32_t *index = &topology->norm_map[0];
+		vector<ofVec3f> &norms = mesh.getNormals();
+
+		for (size_t i = 0; i < num_verts; i++)
+			norms[i] = mixed[index[i]];
+
+		transformDirections(transform.getValue(), norms[0].getPtr(), norms[0].getPtr(), num_verts);
+	}
+	else if (topology->normal_mode != NORMAL_NONE && (attributes & ATTRIBUTE_NORMALS) && view.normals.empty())
+	{
+		OFX_ALEMBIC_TIMER(stats, PHASE_NORMALS);
+		topology->generateNormals(verts, mesh.getNormals());
 	}
 }
 
-void Curves::draw()
+void PolyMesh::swap(PolyMesh &other)
 {
-	for (int i = 0; i < curves.size(); i++)
-	{
-		curves[i].draw();
-	}
-}
\ No newline at end of file
+	mesh.getVertices().swap(other.mesh.getVertices());
+	mesh.getNormals().swap(other.mesh.getNormals());
+	mesh.getTexCoords().swap(other.mesh.getTexCoords());
+	mesh.getColors().swap(other.mesh.getColors());
+	mesh.getIndices().swap(other.mesh.getIndices());
+}
+
+size_t PolyMesh::getMemoryUsage() const
+{
+	return getBufferSize(mesh.getVertices())
+		+ getBufferSize(mesh.getNormals())
+		+ getBufferSize(mesh.getTexCoords())
+		+ getBufferSize(mesh.getColors())
+		+ getBufferSize(mesh.getIndices());
+}
+
+void PolyMesh::release()
+{
+	freeBuffer(mesh.getVertices());
+	freeBuffer(mesh.getNormals());
+	freeBuffer(mesh.getTexCoords());
+	freeBuffer(mesh.getColors());
+	freeBuffer(mesh.getIndices());
+}
+
+#pragma mark - Views
+
+void PolyMeshView::swap(PolyMeshView &other)
+{
+	positions.swap(other.positions);
+	face_indices.swap(other.face_indices);
+	face_counts.swap(other.face_counts);
+	normals.swap(other.normals);
+	normal_indices.swap(other.normal_indices);
+	std::swap(normals_scope, other.normals_scope);
+	uvs.swap(other.uvs);
+	uv_indices.swap(other.uv_indices);
+	std::swap(uvs_scope, other.uvs_scope);
+	std::swap(transform, other.transform);
+}
+
+size_t PolyMeshView::getMemoryUsage() const
+{
+	return positions.getMemoryUsage()
+		+ face_indices.getMemoryUsage()
+		+ face_counts.getMemoryUsage()
+		+ normals.getMemoryUsage()
+		+ normal_indices.getMemoryUsage()
+		+ uvs.getMemoryUsage()
+		+ uv_indices.getMemoryUsage();
+}
+
+void PolyMeshView::reset()
+{
+	positions.reset();
+	face_indices.reset();
+	face_counts.reset();
+	normals.reset();
+	normal_indices.reset();
+	uvs.reset();
+	uv_indices.reset();
+}
+
+size_t PointsView::getMemoryUsage() const
+{
+	return positions.getMemoryUsage()
+		+ ids.getMemoryUsage()
+		+ velocities.getMemoryUsage()
+		+ widths.getMemoryUsage();
+}
+
+void PointsView::reset()
+{
+	positions.reset();
+	ids.reset();
+	velocities.reset();
+	widths.reset();
+}
+
+size_t CurvesView::getMemoryUsage() const
+{
+	return positions.getMemoryUsage() + num_vertices.getMemoryUsage();
+}
+
+void CurvesView::reset()
+{
+	positions.reset();
+	num_vertices.reset();
+}
+
+size_t SampleBlend::getMemoryUsage() const
+{
+	return positions.getMemoryUsage() + normals.getMemoryUsage();
+}
+
+void SampleBlend::reset()
+{
+	floor = ceil = -1;
+	matches = false;
+	positions.reset();
+	normals.reset();
+}
+
+void SampleBlend::swap(SampleBlend &other)
+{
+	std::swap(floor, other.floor);
+	std::swap(ceil, other.ceil);
+	std::swap(matches, other.matches);
+	positions.swap(other.positions);
+	normals.swap(other.normals);
+}
+
+void PointsView::swap(PointsView &other)
+{
+	positions.swap(other.positions);
+	ids.swap(other.ids);
+	velocities.swap(other.velocities);
+	widths.swap(other.widths);
+	std::swap(transform, other.transform);
+}
+
+void CurvesView::swap(CurvesView &other)
+{
+	positions.swap(other.positions);
+	num_vertices.swap(other.num_vertices);
+	std::swap(transform, other.transform);
+}
+
+#pragma mark - PolyMeshTopology
+
+bool PolyMeshTopology::build(const Int32ArraySample &counts, const Int32ArraySample &face_indices, size_t num_points_)
+{
+	valid = false;
+
+	corners.clear();
+	points.clear();
+	faces.clear();
+	indices.clear();
+	uv_map.clear();
+	norm_map.clear();
+	uv_weld_pairs.clear();
+	norm_weld_pairs.clear();
+	adjacency_offsets.clear();
+	adjacency.clear();
+	adjacency_mode = NORMAL_NONE;
+
+	num_points = num_points_;
+	num_corners = face_indices.size();
+	num_faces = counts.size();
+
+	size_t numFaces = num_faces;
+	size_t numIndices = num_corners;
+	if (numFaces < 1 ||
+		numIndices < 1 ||
+		num_points < 1)
+	{
+		return false;
+	}
+
+	size_t num_tris = 0;
+	for (size_t face = 0; face < numFaces; ++face)
+	{
+		if (counts[face] > 2) num_tris += counts[face] - 2;
+	}
+
+	reserveBuffer(corners, num_tris * 3);
+	reserveBuffer(faces, num_tris * 3);
+
+	size_t faceIndexBegin = 0;
+	size_t faceIndexEnd = 0;
+	for (size_t face = 0; face < numFaces; ++face)
+	{
+		faceIndexBegin = faceIndexEnd;
+		size_t count = counts[face];
+		faceIndexEnd = faceIndexBegin + count;
+
+		// Check this face is valid
+		if (faceIndexEnd > numIndices ||
+			faceIndexEnd < faceIndexBegin)
+		{
+			ofLogError("ofxAlembic") << "Mesh update quitting on face: "
+			<< face
+			<< " because of wonky numbers"
+			<< ", faceIndexBegin = " << faceIndexBegin
+			<< ", faceIndexEnd = " << faceIndexEnd
+			<< ", numIndices = " << numIndices
+			<< ", count = " << count;
+
+			// Just get out, make no more triangles.
+			break;
+		}
+
+		// Make triangles to fill this face.
+		for (size_t c = 2; c < count; ++c)
+		{
+			corners.push_back(faceIndexBegin + 0);
+			corners.push_back(faceIndexBegin + c - 1);
+			corners.push_back(faceIndexBegin + c);
+
+			faces.push_back(face);
+			faces.push_back(face);
+			faces.push_back(face);
+		}
+	}
+
+	if (corners.empty()) return false;
+
+	resizeBuffer(points, corners.size());
+
+	for (size_t i = 0; i < corners.size(); i++)
+	{
+		::int32_t index = face_indices[corners[i]];
+
+		if (index < 0 || index >= num_points)
+		{
+			ofLogError("ofxAlembic") << "Mesh face index out of range: " << index;
+			corners.clear();
+			points.clear();
+			faces.clear();
+			return false;
+		}
+
+		points[i] = index;
+	}
+
+	valid = true;
+	return true;
+}
+
+void PolyMeshTopology::weld(const V2fArraySamplePtr &uvs, const N3fArraySamplePtr &norms, bool split_faces)
+{
+	const size_t num_tri_verts = points.size();
+
+	const ::int32_t *uv_index = uv_map.size() == num_tri_verts ? &uv_map[0] : NULL;
+	const ::int32_t *norm_index = norm_map.size() == num_tri_verts ? &norm_map[0] : NULL;
+
+	vector< ::int32_t> &first = scratch_first; // first output vertex of each position
+	vector< ::int32_t> &next = scratch_next; // next output vertex sharing the same position
+	vector< ::int32_t> &source = scratch_source; // triangle vertex each output vertex was made from
+
+	vector< ::int32_t> &out_corners = scratch_corners;
+	vector< ::int32_t> &out_points = scratch_points;
+	vector< ::int32_t> &out_faces = scratch_faces;
+
+	resizeBuffer(first, num_points);
+	std::fill(first.begin(), first.end(), -1);
+
+	next.clear();
+	source.clear();
+	uv_weld_pairs.clear();
+	norm_weld_pairs.clear();
+	out_corners.clear();
+	out_points.clear();
+	out_faces.clear();
+
+	// never more output vertices than triangle vertices
+	reserveBuffer(next, num_tri_verts);
+	reserveBuffer(source, num_tri_verts);
+	reserveBuffer(out_corners, num_tri_verts);
+	reserveBuffer(out_points, num_tri_verts);
+	reserveBuffer(out_faces, num_tri_verts);
+
+	resizeBuffer(indices, num_tri_verts);
+
+	for (size_t i = 0; i < num_tri_verts; i++)
+	{
+		::int32_t v = first[points[i]];
+
+		// split only where the face-varying attributes differ
+		while (v >= 0)
+		{
+			::int32_t s = source[v];
+
+			// the same value index always holds the same value, equal values are remembered for later samples
+			const bool uv_same = !uv_index || uv_index[i] == uv_index[s];
+			const bool norm_same = !norm_index || norm_index[i] == norm_index[s];
+
+			if ((uv_same || (uvs && (*uvs)[uv_index[i]] == (*uvs)[uv_index[s]]))
+				&& (norm_same || (norms && (*norms)[norm_index[i]] == (*norms)[norm_index[s]]))
+				&& (!split_faces || faces[i] == faces[s]))
+			{
+				if (!uv_same)
+				{
+					uv_weld_pairs.push_back(uv_index[i]);
+					uv_weld_pairs.push_back(uv_index[s]);
+				}
+
+				if (!norm_same)
+				{
+					norm_weld_pairs.push_back(norm_index[i]);
+					norm_weld_pairs.push_back(norm_index[s]);
+				}
+
+				break;
+			}
+
+			v = next[v];
+		}
+
+		if (v < 0)
+		{
+			v = out_points.size();
+
+			out_corners.push_back(corners[i]);
+			out_points.push_back(points[i]);
+			out_faces.push_back(faces[i]);
+
+			source.push_back(i);
+			next.push_back(first[points[i]]);
+			first[points[i]] = v;
+		}
+
+		indices[i] = v;
+	}
+
+	// the old per-triangle arrays become the scratch of the next weld
+	corners.swap(out_corners);
+	points.swap(out_points);
+	faces.swap(out_faces);
+}
+
+template <typename T>
+static bool isSameValues(const T &values, const vector< ::int32_t> &pairs)
+{
+	if (!values || pairs.empty()) return true;
+
+	const size_t num = values->size();
+
+	for (size_t i = 0; i < pairs.size(); i += 2)
+	{
+		if ((size_t)pairs[i] >= num || (size_t)pairs[i + 1] >= num
+			|| (*values)[pairs[i]] != (*values)[pairs[i + 1]])
+			return false;
+	}
+
+	return true;
+}
+
+bool PolyMeshTopology::isWeldValid(const V2fArraySamplePtr &uvs, const N3fArraySamplePtr &norms) const
+{
+	return isSameValues(uvs, uv_weld_pairs) && isSameValues(norms, norm_weld_pairs);
+}
+
+bool PolyMeshTopology::mapAttribute(GeometryScope scope, size_t num_values, const UInt32ArraySamplePtr &value_indices, vector< ::int32_t> &map) const
+{
+	const size_t size = value_indices ? value_indices->size() : num_values;
+
+	// a single value for the whole mesh, every vertex gets it
+	if (scope == kConstantScope)
+	{
+		const size_t k = value_indices && size ? (*value_indices)[0] : 0;
+
+		if (size < 1 || points.empty() || k >= num_values)
+		{
+			map.clear();
+			return false;
+		}
+
+		resizeBuffer(map, points.size());
+		std::fill(map.begin(), map.end(), (::int32_t)k);
+		return true;
+	}
+
+	const ::int32_t *index = getAttributeIndices(scope, size);
+
+	if (index == NULL)
+	{
+		map.clear();
+		return false;
+	}
+
+	const size_t num = points.size();
+	resizeBuffer(map, num);
+
+	for (size_t i = 0; i < num; i++)
+	{
+		const size_t k = value_indices ? (*value_indices)[index[i]] : index[i];
+
+		if (k >= num_values)
+		{
+			ofLogError("ofxAlembic") << "Mesh attribute index out of range: " << k;
+			map.clear();
+			return false;
+		}
+
+		map[i] = k;
+	}
+
+	return true;
+}
+
+const Alembic::Util::int32_t* PolyMeshTopology::getAttributeIndices(GeometryScope scope, size_t size) const
+{
+	if (points.empty()) return NULL;
+
+	switch (scope)
+	{
+		case kFacevaryingScope:
+			if (size >= num_corners) return &corners[0];
+			break;
+
+		case kVertexScope:
+		case kVaryingScope:
+			if (size >= num_points) return &points[0];
+			break;
+
+		case kUniformScope:
+			if (size >= num_faces) return &faces[0];
+			break;
+
+		case kConstantScope:
+			// no index table, mapAttribute() broadcasts the value
+			return NULL;
+
+		case kUnknownScope:
+			break;
+
+		default:
+			ofLogError("ofxAlembic") << "unknown geometry scope " << scope << ", guessing from the number of values";
+			break;
+	}
+
+	// unknown or mismatching scope, guess from the number of values
+	if (size == num_corners) return &corners[0];
+	if (size == num_points) return &points[0];
+	if (size == num_faces) return &faces[0];
+
+	return NULL;
+}
+
+// one range of a generateNormals() pass
+struct NormalTask : public TaskPool::Task
+{
+	enum Pass
+	{
+		TRIANGLES = 0,
+		SHARED,
+		VERTICES
+	};
+
+	PolyMeshTopology *topology;
+	const ofVec3f *verts;
+	ofVec3f *norms;
+	Pass pass;
+	size_t begin;
+	size_t end;
+
+	void run()
+	{
+		PolyMeshTopology &t = *topology;
+
+		switch (pass)
+		{
+			case TRIANGLES:
+				if (t.indexed)
+					computeTriangleNormals(verts[0].getPtr(), &t.indices[begin * 3], t.triangle_normals[begin].getPtr(), end - begin);
+				else
+					computeTriangleNormals(verts[begin * 3].getPtr(), NULL, t.triangle_normals[begin].getPtr(), end - begin);
+				break;
+
+			case SHARED:
+			{
+				const ::int32_t *offsets = &t.adjacency_offsets[0];
+				const ::int32_t *adjacent = &t.adjacency[0];
+				const ofVec3f *src = &t.triangle_normals[0];
+
+				for (size_t i = begin; i < end; i++)
+				{
+					float x = 0, y = 0, z = 0;
+
+					for (::int32_t k = offsets[i]; k < offsets[i + 1]; k++)
+					{
+						const ofVec3f &n = src[adjacent[k]];
+						x += n.x;
+						y += n.y;
+						z += n.z;
+					}
+
+					t.shared_normals[i] = ofVec3f(x, y, z);
+				}
+
+				normalizeDirections(t.shared_normals[begin].getPtr(), end - begin);
+				break;
+			}
+
+			case VERTICES:
+			{
+				const ::int32_t *key = t.normal_mode == NORMAL_FLAT ? &t.faces[0] : &t.points[0];
+				const ofVec3f *src = &t.shared_normals[0];
+
+				for (size_t i = begin; i < end; i++)
+					norms[i] = src[key[i]];
+				break;
+			}
+		}
+	}
+};
+
+static void runNormalPass(PolyMeshTopology &topology, NormalTask::Pass pass, size_t num, const ofVec3f *verts, ofVec3f *norms)
+{
+	const size_t MAX_TASKS = 64;
+	const size_t MIN_RANGE = 4096;
+
+	size_t num_tasks = 1;
+
+	if (topology.pool && topology.pool->getNumThreads() > 0)
+	{
+		num_tasks = MIN((size_t)topology.pool->getNumThreads() * 4, MAX_TASKS);
+		num_tasks = MAX((size_t)1, MIN(num_tasks, num / MIN_RANGE));
+	}
+
+	NormalTask tasks[MAX_TASKS];
+	TaskPool::Task *task_ptrs[MAX_TASKS];
+
+	for (size_t i = 0; i < num_tasks; i++)
+	{
+		NormalTask &task = tasks[i];
+		task.topology = &topology;
+		task.verts = verts;
+		task.norms = norms;
+		task.pass = pass;
+		task.begin = num * i / num_tasks;
+		task.end = num * (i + 1) / num_tasks;
+		task_ptrs[i] = &task;
+	}
+
+	if (num_tasks == 1)
+		tasks[0].run();
+	else
+		topology.pool->run(task_ptrs, num_tasks);
+}
+
+// CSR lists of the triangles around each position, or in each face
+static void buildAdjacency(PolyMeshTopology &topology)
+{
+	const bool flat = topology.normal_mode == NORMAL_FLAT;
+	const vector< ::int32_t> &keys = flat ? topology.faces : topology.points;
+
+	const size_t num_keys = flat ? topology.num_faces : topology.num_points;
+	const size_t num_tris = topology.indexed ? topology.indices.size() / 3 : topology.points.size() / 3;
+	const size_t corners_per_tri = flat ? 1 : 3; // the corners of a triangle all lie in its face
+
+	vector< ::int32_t> &offsets = topology.adjacency_offsets;
+	vector< ::int32_t> &cursor = topology.scratch_first;
+
+	resizeBuffer(offsets, num_keys + 1);
+	std::fill(offsets.begin(), offsets.end(), 0);
+
+	for (size_t t = 0; t < num_tris; t++)
+	{
+		for (size_t c = 0; c < corners_per_tri; c++)
+		{
+			const size_t v = topology.indexed ? topology.indices[t * 3 + c] : t * 3 + c;
+			offsets[keys[v] + 1]++;
+		}
+	}
+
+	for (size_t i = 0; i < num_keys; i++)
+		offsets[i + 1] += offsets[i];
+
+	resizeBuffer(topology.adjacency, offsets[num_keys]);
+	resizeBuffer(cursor, num_keys);
+	std::copy(offsets.begin(), offsets.end() - 1, cursor.begin());
+
+	for (size_t t = 0; t < num_tris; t++)
+	{
+		for (size_t c = 0; c < corners_per_tri; c++)
+		{
+			const size_t v = topology.indexed ? topology.indices[t * 3 + c] : t * 3 + c;
+			topology.adjacency[cursor[keys[v]]++] = t;
+		}
+	}
+
+	topology.adjacency_mode = topology.normal_mode;
+}
+
+void PolyMeshTopology::generateNormals(const vector<ofVec3f> &verts, vector<ofVec3f> &norms)
+{
+	const size_t num_verts = points.size();
+	const size_t num_tris = indexed ? indices.size() / 3 : num_verts / 3;
+
+	if (normal_mode == NORMAL_NONE || num_tris == 0 || verts.size() != num_verts)
+	{
+		norms.clear();
+		return;
+	}
+
+	if (adjacency_mode != normal_mode)
+		buildAdjacency(*this);
+
+	const size_t num_shared = adjacency_offsets.size() - 1;
+
+	resizeBuffer(triangle_normals, num_tris);
+	resizeBuffer(shared_normals, num_shared);
+	resizeBuffer(norms, num_verts);
+
+	runNormalPass(*this, NormalTask::TRIANGLES, num_tris, &verts[0], &norms[0]);
+	runNormalPass(*this, NormalTask::SHARED, num_shared, &verts[0], &norms[0]);
+	runNormalPass(*this, NormalTask::VERTICES, num_verts, &verts[0], &norms[0]);
+}
+
+void PolyMeshTopology::release()
+{
+	freeBuffer(corners);
+	freeBuffer(points);
+	freeBuffer(faces);
+	freeBuffer(indices);
+	freeBuffer(uv_map);
+	freeBuffer(norm_map);
+	freeBuffer(uv_weld_pairs);
+	freeBuffer(norm_weld_pairs);
+	num_uv_values = num_norm_values = 0;
+
+	freeBuffer(adjacency_offsets);
+	freeBuffer(adjacency);
+	freeBuffer(triangle_normals);
+	freeBuffer(shared_normals);
+	freeBuffer(blend_scratch);
+	adjacency_mode = NORMAL_NONE;
+
+	freeBuffer(scratch_first);
+	freeBuffer(scratch_next);
+	freeBuffer(scratch_source);
+	freeBuffer(scratch_corners);
+	freeBuffer(scratch_points);
+	freeBuffer(scratch_faces);
+
+	num_points = num_corners = num_faces = 0;
+	valid = false;
+}
+
+size_t PolyMeshTopology::getMemoryUsage() const
+{
+	return getBufferSize(corners)
+		+ getBufferSize(points)
+		+ getBufferSize(faces)
+		+ getBufferSize(indices)
+		+ getBufferSize(uv_map)
+		+ getBufferSize(norm_map)
+		+ getBufferSize(uv_weld_pairs)
+		+ getBufferSize(norm_weld_pairs)
+		+ getBufferSize(adjacency_offsets)
+		+ getBufferSize(adjacency)
+		+ getBufferSize(triangle_normals)
+		+ getBufferSize(shared_normals)
+		+ getBufferSize(blend_scratch)
+		+ getBufferSize(scratch_first)
+		+ getBufferSize(scratch_next)
+		+ getBufferSize(scratch_source)
+		+ getBufferSize(scratch_corners)
+		+ getBufferSize(scratch_points)
+		+ getBufferSize(scratch_faces);
+}
+
+void PolyMeshTopology::swap(PolyMeshTopology &other)
+{
+	corners.swap(other.corners);
+	points.swap(other.points);
+	faces.swap(other.faces);
+	indices.swap(other.indices);
+	uv_map.swap(other.uv_map);
+	norm_map.swap(other.norm_map);
+	uv_weld_pairs.swap(other.uv_weld_pairs);
+	norm_weld_pairs.swap(other.norm_weld_pairs);
+	std::swap(num_uv_values, other.num_uv_values);
+	std::swap(num_norm_values, other.num_norm_values);
+	std::swap(num_points, other.num_points);
+	std::swap(num_corners, other.num_corners);
+	std::swap(num_faces, other.num_faces);
+	std::swap(transform, other.transform);
+	std::swap(indexed, other.indexed);
+	std::swap(valid, other.valid);
+	std::swap(normal_mode, other.normal_mode);
+	std::swap(pool, other.pool);
+	adjacency_offsets.swap(other.adjacency_offsets);
+	adjacency.swap(other.adjacency);
+	std::swap(adjacency_mode, other.adjacency_mode);
+}
+
+#pragma mark - Curves
+
+Curves::Curves(const vector<ofPolyline> &curves)
+{
+	size_t num = 0;
+	for (size_t n = 0; n < curves.size(); n++)
+		num += curves[n].size();
+
+	positions.reserve(num);
+	counts.reserve(curves.size());
+	offsets.reserve(curves.size());
+
+	for (size_t n = 0; n < curves.size(); n++)
+		addCurve(curves[n]);
+}
+
+void Curves::addCurve(const ofVec3f *vertices, size_t num)
+{
+	offsets.push_back(positions.size());
+	counts.push_back(num);
+	positions.insert(positions.end(), vertices, vertices + num);
+}
+
+void Curves::addCurve(const ofPolyline &polyline)
+{
+	const vector<ofVec3f> &verts = polyline.getVertices();
+	addCurve(verts.empty() ? NULL : &verts[0], verts.size());
+}
+
+void Curves::clear()
+{
+	positions.clear();
+	counts.clear();
+	offsets.clear();
+}
+
+void Curves::getPolylines(vector<ofPolyline> &curves) const
+{
+	curves.resize(counts.size());
+
+	for (size_t n = 0; n < counts.size(); n++)
+	{
+		vector<ofVec3f> &verts = curves[n].getVertices();
+		verts.assign(positions.begin() + offsets[n], positions.begin() + offsets[n] + counts[n]);
+	}
+}
+
+void Curves::swap(Curves &other)
+{
+	positions.swap(other.positions);
+	counts.swap(other.counts);
+	offsets.swap(other.offsets);
+}
+
+void Curves::get(OCurvesSchema &schema) const
+{
+	get(schema, true);
+}
+
+Alembic::Util::uint64_t Curves::getTopologyDigest() const
+{
+	Alembic::Util::uint64_t h = digest(digest_basis, counts.size());
+
+	if (!counts.empty())
+		h = digest(h, &counts[0], counts.size() * sizeof(counts[0]));
+
+	return h;
+}
+
+void Curves::get(OCurvesSchema &schema, bool with_topology, Stats *stats) const
+{
+	OFX_ALEMBIC_TIMER(stats, PHASE_WRITE);
+
+	// ofVec3f and V3f are both three packed floats, both arrays go out without a copy
+	const V3f *p = positions.empty() ? NULL : (const V3f*)positions[0].getPtr();
+	const Alembic::Util::int32_t *n = counts.empty() ? NULL : &counts[0];
+
+	OCurvesSchema::Sample sample(P3fArraySample(p, positions.size()),
+								 with_topology ? Int32ArraySample(n, counts.size()) : Int32ArraySample(),
+								 kLinear,
+								 kNonPeriodic);
+	schema.set(sample);
+}
+
+size_t Curves::getMemoryUsage() const
+{
+	return getBufferSize(positions)
+		+ getBufferSize(counts)
+		+ getBufferSize(offsets);
+}
+
+void Curves::release()
+{
+	freeBuffer(positions);
+	freeBuffer(counts);
+	freeBuffer(offsets);
+}
+
+void Curves::set(ICurvesSchema &schema, float time, const Imath::M44f& transform)
+{
+	set(schema, ISampleSelector(time, ISampleSelector::kNearIndex), transform, NULL);
+}
+
+void Curves::set(ICurvesSchema &schema, const ISampleSelector &ss, const Imath::M44f& transform, CurvesView *view, Stats *stats)
+{
+	ICurvesSchema::Sample sample;
+
+	{
+		OFX_ALEMBIC_TIMER(stats, PHASE_READ);
+		ArchiveLock lock;
+		schema.get(sample, ss);
+	}
+
+	P3fArraySamplePtr m_positions = sample.getPositions();
+	Int32ArraySamplePtr m_counts = sample.getCurvesNumVertices();
+
+	if (view)
+	{
+		view->positions = m_positions;
+		view->num_vertices = m_counts;
+		view->transform = transform;
+	}
+
+	const size_t num_curves = m_counts ? m_counts->size() : 0;
+	const size_t num_verts = m_positions ? m_positions->size() : 0;
+
+	{
+		OFX_ALEMBIC_TIMER(stats, PHASE_BUILD);
+
+		resizeBuffer(counts, num_curves);
+		resizeBuffer(offsets, num_curves);
+
+		const Alembic::Util::int32_t *src = num_curves ? m_counts->get() : NULL;
+		Alembic::Util::int32_t offset = 0;
+
+		for (size_t i = 0; i < num_curves; i++)
+		{
+			// clamp broken samples to the positions that are actually there
+			const Alembic::Util::int32_t num = std::max(0, std::min(src[i], (Alembic::Util::int32_t)num_verts - offset));
+
+			counts[i] = num;
+			offsets[i] = offset;
+			offset += num;
+		}
+	}
+
+	OFX_ALEMBIC_TIMER(stats, PHASE_TRANSFORM);
+
+	resizeBuffer(positions, num_verts);
+
+	if (num_verts)
+		transformPoints(transform.getValue(), m_positions->get()->getValue(), positions[0].getPtr(), num_verts);
+}
+
+void Curves::readBlend(ICurvesSchema &schema, const ISampleSelector &ss, const CurvesView &view, SampleBlend &target, Stats *stats)
+{
+	P3fArraySamplePtr positions;
+	Int32ArraySamplePtr num_vertices;
+
+	{
+		OFX_ALEMBIC_TIMER(stats, PHASE_READ);
+		ArchiveLock lock;
+
+		schema.getPositionsProperty().get(positions, ss);
+		schema.getNumVerticesProperty().get(num_vertices, ss);
+	}
+
+	target.positions = positions;
+	target.normals.reset();
+	target.matches = positions && positions->size() == view.positions.size()
+		&& isSameArray(num_vertices, view.num_vertices);
+}
+
+void Curves::blend(const CurvesView &view, const SampleBlend &target, float alpha, const Imath::M44f& transform, Stats *stats)
+{
+	const size_t num_verts = view.positions.size();
+	if (num_verts == 0 || num_verts != target.positions.size() || positions.size() != num_verts) return;
+
+	OFX_ALEMBIC_TIMER(stats, PHASE_INTERPOLATE);
+
+	lerpFloats(view.positions.data()->getValue(), target.positions.data()->getValue(), positions[0].getPtr(), num_verts * 3, alpha);
+	transformPoints(transform.getValue(), positions[0].getPtr(), positions[0].getPtr(), num_verts);
+}
@@ -7,16 +7,26 @@
 
 
 #include "ofxAlembicUtil.h"
+#include "ofxAlembicStats.h"
 
 
 namespace ofxAlembic
 {
 class PolyMesh;
+class PolyMeshTopology;
+class TaskPool;
+struct MemoryUsage;
 class Points;
 class Curves;
 
 struct Point;
 
+template <typename T> class ArrayView;
+struct PolyMeshView;
+struct PointsView;
+struct CurvesView;
+struct SampleBlend;
+
 enum Type
 {
 	POINTS = 0,
@@ -24,6 +34,26 @@ enum Type
 	POLYMESH,
 	UNKHOWN
 };
+
+// bit mask of the attributes a reader fetches and converts, positions are always decoded
+enum Attribute
+{
+	ATTRIBUTE_POSITIONS = 1 << 0,
+	ATTRIBUTE_NORMALS = 1 << 1,
+	ATTRIBUTE_UVS = 1 << 2,
+	ATTRIBUTE_IDS = 1 << 3,
+	ATTRIBUTE_VELOCITIES = 1 << 4,
+	ATTRIBUTE_WIDTHS = 1 << 5,
+	ATTRIBUTE_ALL = 0xff
+};
+
+// normals generated by the reader for meshes stored without any
+enum NormalMode
+{
+	NORMAL_NONE = 0,
+	NORMAL_SMOOTH, // area weighted average of the faces around each position
+	NORMAL_FLAT // one normal per face
+};
 }
 
 struct ofxAlembic::Point
@@ -39,6 +69,220 @@ struct ofxAlembic::Point
 	Point(uint64_t id, float x, float y, float z) : id(id), pos(x, y, z) {}
 };
 
+// bytes held by a decoded object: converted geometry, decode temporaries and Alembic samples kept alive by views
+
+struct ofxAlembic::MemoryUsage
+{
+	size_t decoded;
+	size_t scratch;
+	size_t cache;
+
+	MemoryUsage() : decoded(0), scratch(0), cache(0) {}
+
+	inline size_t getTotal() const { return decoded + scratch + cache; }
+
+	inline void add(const MemoryUsage& other)
+	{
+		decoded += other.decoded;
+		scratch += other.scratch;
+		cache += other.cache;
+	}
+};
+
+// read-only span over an Alembic array sample, holding a reference keeps the sample alive
+
+template <typename T>
+class ofxAlembic::ArrayView
+{
+public:
+	typedef typename T::value_type value_type;
+	typedef Alembic::Util::shared_ptr<T> sample_ptr;
+
+	ArrayView() {}
+	ArrayView(const sample_ptr& sample) : sample(sample) {}
+
+	inline const value_type* data() const { return sample ? sample->get() : NULL; }
+	inline size_t size() const { return sample ? sample->size() : 0; }
+	inline bool empty() const { return size() == 0; }
+
+	inline const value_type& operator[](size_t i) const { return data()[i]; }
+
+	inline const sample_ptr& getSample() const { return sample; }
+
+	// bytes of the referenced sample, shared with anyone else holding it
+	inline size_t getMemoryUsage() const { return size() * sizeof(value_type); }
+
+	void reset() { sample.reset(); }
+	void swap(ArrayView &other) { sample.swap(other.sample); }
+
+protected:
+	sample_ptr sample;
+};
+
+// the raw samples a decoded object was built from, in object space.
+// `transform` is the accumulated parent transform the reader baked into the decoded data.
+
+struct ofxAlembic::PolyMeshView
+{
+	ArrayView<Alembic::AbcGeom::P3fArraySample> positions;
+	ArrayView<Alembic::AbcGeom::Int32ArraySample> face_indices;
+	ArrayView<Alembic::AbcGeom::Int32ArraySample> face_counts;
+
+	// indexed params keep their values unexpanded, `*_indices` is empty when the param is not indexed
+	ArrayView<Alembic::AbcGeom::N3fArraySample> normals;
+	ArrayView<Alembic::AbcGeom::UInt32ArraySample> normal_indices;
+	Alembic::AbcGeom::GeometryScope normals_scope;
+
+	ArrayView<Alembic::AbcGeom::V2fArraySample> uvs;
+	ArrayView<Alembic::AbcGeom::UInt32ArraySample> uv_indices;
+	Alembic::AbcGeom::GeometryScope uvs_scope;
+
+	Imath::M44f transform;
+
+	PolyMeshView() : normals_scope(Alembic::AbcGeom::kUnknownScope), uvs_scope(Alembic::AbcGeom::kUnknownScope) {}
+
+	size_t getMemoryUsage() const;
+	void reset();
+	void swap(PolyMeshView &other);
+};
+
+struct ofxAlembic::PointsView
+{
+	ArrayView<Alembic::AbcGeom::P3fArraySample> positions;
+	ArrayView<Alembic::AbcGeom::UInt64ArraySample> ids;
+	ArrayView<Alembic::AbcGeom::V3fArraySample> velocities;
+	ArrayView<Alembic::AbcGeom::FloatArraySample> widths;
+
+	Imath::M44f transform;
+
+	size_t getMemoryUsage() const;
+	void reset();
+	void swap(PointsView &other);
+};
+
+struct ofxAlembic::CurvesView
+{
+	ArrayView<Alembic::AbcGeom::P3fArraySample> positions;
+	ArrayView<Alembic::AbcGeom::Int32ArraySample> num_vertices;
+
+	Imath::M44f transform;
+
+	size_t getMemoryUsage() const;
+	void reset();
+	void swap(CurvesView &other);
+};
+
+// the later of the two samples an interpolating reader blends between, the earlier one is in the object's view.
+// kept by the object, moving between the same two samples reads nothing
+
+struct ofxAlembic::SampleBlend
+{
+	Alembic::AbcGeom::index_t floor; // sample the view was decoded from
+	Alembic::AbcGeom::index_t ceil; // sample after it, -1 when nothing is read
+	bool matches; // same topology as the floor sample, otherwise nothing is blended
+
+	ArrayView<Alembic::AbcGeom::P3fArraySample> positions;
+	ArrayView<Alembic::AbcGeom::N3fArraySample> normals; // empty for constant normals
+
+	SampleBlend() : floor(-1), ceil(-1), matches(false) {}
+
+	inline bool isCached(Alembic::AbcGeom::index_t floor_, Alembic::AbcGeom::index_t ceil_) const { return floor == floor_ && ceil == ceil_; }
+
+	size_t getMemoryUsage() const;
+	void reset();
+	void swap(SampleBlend &other);
+};
+
+// triangulation of a polymesh sample, reused while the mesh topology does not vary
+
+class ofxAlembic::PolyMeshTopology
+{
+public:
+	// per output vertex
+	vector<Alembic::Util::int32_t> corners; // face index corner
+	vector<Alembic::Util::int32_t> points; // position index
+	vector<Alembic::Util::int32_t> faces; // face index
+
+	// triangle index buffer, only used in indexed mode
+	vector<ofIndexType> indices;
+
+	// per output vertex, index into the uv and normal values with scope and param indices resolved
+	vector<Alembic::Util::int32_t> uv_map;
+	vector<Alembic::Util::int32_t> norm_map;
+	size_t num_uv_values;
+	size_t num_norm_values;
+
+	// value index pairs weld() merged because their values were equal, not their indices.
+	// animated values are checked against every new sample, see isWeldValid()
+	vector<Alembic::Util::int32_t> uv_weld_pairs;
+	vector<Alembic::Util::int32_t> norm_weld_pairs;
+
+	size_t num_points;
+	size_t num_corners;
+	size_t num_faces;
+
+	Imath::M44f transform; // transform the current normals were decoded with
+
+	bool indexed;
+	bool valid;
+
+	NormalMode normal_mode; // used when the archive has no normals
+	TaskPool *pool; // generates normals in parallel, NULL runs on the calling thread
+
+	// triangles around each position (smooth) or face (flat), triangle t owns the output vertices
+	// t * 3 to t * 3 + 2, or the ones in `indices` when indexed. built once per topology.
+	vector<Alembic::Util::int32_t> adjacency_offsets;
+	vector<Alembic::Util::int32_t> adjacency;
+	NormalMode adjacency_mode;
+
+	// generateNormals() temporaries
+	vector<ofVec3f> triangle_normals;
+	vector<ofVec3f> shared_normals;
+
+	// PolyMesh::blend() temporary, the two samples mixed before they are expanded per vertex
+	vector<ofVec3f> blend_scratch;
+
+	// weld() temporaries, kept to reuse their capacity
+	vector<Alembic::Util::int32_t> scratch_first, scratch_next, scratch_source;
+	vector<Alembic::Util::int32_t> scratch_corners, scratch_points, scratch_faces;
+
+	PolyMeshTopology() : num_uv_values(0), num_norm_values(0), num_points(0), num_corners(0), num_faces(0), indexed(false), valid(false),
+		normal_mode(NORMAL_NONE), pool(NULL), adjacency_mode(NORMAL_NONE) {}
+
+	bool build(const Alembic::AbcGeom::Int32ArraySample &counts, const Alembic::AbcGeom::Int32ArraySample &face_indices, size_t num_points);
+
+	// merge triangle vertices sharing a position, splitting only where uvs or normals differ.
+	// compares the value indices in uv_map and norm_map, which have to be mapped again afterwards.
+	// `uvs` and `norms` additionally merge equal values, those merges are recorded in the weld pairs.
+	// `split_faces` keeps every face apart, for generated flat normals.
+	void weld(const Alembic::AbcGeom::V2fArraySamplePtr &uvs, const Alembic::AbcGeom::N3fArraySamplePtr &norms, bool split_faces = false);
+
+	// false once `uvs` or `norms` differ where weld() merged equal values, the topology has to be welded again.
+	// NULL samples are not checked
+	bool isWeldValid(const Alembic::AbcGeom::V2fArraySamplePtr &uvs, const Alembic::AbcGeom::N3fArraySamplePtr &norms) const;
+
+	// fills `norms` per output vertex from the final vertex positions, following normal_mode.
+	// only the triangle normals and their sums are computed per frame, the adjacency is reused.
+	void generateNormals(const vector<ofVec3f> &verts, vector<ofVec3f> &norms);
+
+	// maps each output vertex to an attribute value of the given scope, NULL if the size does not fit.
+	// constant scope has no table, mapAttribute() handles it
+	const Alembic::Util::int32_t* getAttributeIndices(Alembic::AbcGeom::GeometryScope scope, size_t size) const;
+
+	// fills `map` with the value of every output vertex, `value_indices` may be NULL for a param that is
+	// not indexed. clears `map` and returns false when scope or indices do not fit this topology.
+	bool mapAttribute(Alembic::AbcGeom::GeometryScope scope, size_t num_values,
+					  const Alembic::AbcGeom::UInt32ArraySamplePtr &value_indices, vector<Alembic::Util::int32_t> &map) const;
+
+	void invalidate() { valid = false; }
+
+	// invalidates and frees every buffer
+	void release();
+	size_t getMemoryUsage() const;
+
+	void swap(PolyMeshTopology &other);
+};
+
 class ofxAlembic::PolyMesh
 {
 public:
@@ -48,37 +292,127 @@ public:
 	PolyMesh(const ofMesh& mesh) : mesh(mesh) {}
 
 	void get(Alembic::AbcGeom::OPolyMeshSchema &schema) const;
+
+	// without topology only positions, uvs and normals are written, the schema repeats the previous face layout
+	void get(Alembic::AbcGeom::OPolyMeshSchema &schema, bool with_topology, Stats *stats = NULL) const;
+
+	// hash of the face layout, equal digests write the same face indices and counts
+	Alembic::Util::uint64_t getTopologyDigest() const;
+
 	void set(Alembic::AbcGeom::IPolyMeshSchema &schema, float time, const Imath::M44f& transform);
+	void set(Alembic::AbcGeom::IPolyMeshSchema &schema, const Alembic::AbcGeom::ISampleSelector &ss, const Imath::M44f& transform);
+
+	// streams positions only while `topology` is valid for this mesh, `view` receives the samples read,
+	// `stats` the time spent in each phase. normals and uvs missing from `attributes` are not read.
+	// in indexed mode the topology has to be invalidated when `attributes` change.
+	void set(Alembic::AbcGeom::IPolyMeshSchema &schema, const Alembic::AbcGeom::ISampleSelector &ss, const Imath::M44f& transform, PolyMeshTopology *topology, PolyMeshView *view = NULL, Stats *stats = NULL, unsigned int attributes = ATTRIBUTE_ALL);
+
+	// reads the positions and animated normals of `ss` into `target`, which only matches `view` when the
+	// face layout is the same. heterogenous meshes are compared index by index.
+	static void readBlend(Alembic::AbcGeom::IPolyMeshSchema &schema, const Alembic::AbcGeom::ISampleSelector &ss, const PolyMeshView &view, SampleBlend &target, Stats *stats = NULL, unsigned int attributes = ATTRIBUTE_ALL);
+
+	// rebuilds positions and normals of the mesh decoded from `view` as a mix towards `target`, `alpha` being the
+	// weight of `target`. uvs and faces stay those of the view, generated normals are generated again.
+	void blend(const PolyMeshView &view, const SampleBlend &target, float alpha, const Imath::M44f& transform, PolyMeshTopology *topology, Stats *stats = NULL, unsigned int attributes = ATTRIBUTE_ALL);
 
+	void swap(PolyMesh &other);
+
+	// bytes of the ofMesh buffers, release() frees them
+	size_t getMemoryUsage() const;
+	void release();
+
+#ifndef OFX_ALEMBIC_NO_GL
 	void draw();
 	void drawTextured( ofImage *tex );
+#endif
 };
 
+// point cloud as separate arrays, positions are contiguous floats for SIMD and GPU upload.
+// ids, velocities and widths are optional, they are only used when they match the number of positions
+// (widths may also hold a single constant value). without ids every point is written with Point's default id (-1).
+
 class ofxAlembic::Points
 {
 public:
-	vector<Point> points;
+	vector<ofVec3f> positions;
+	vector<uint64_t> ids;
+	vector<ofVec3f> velocities;
+	vector<float> widths;
 
 	Points() {}
-	Points(const vector<ofVec3f>& points);
-	Points(const vector<Point>& points) : points(points) {}
+	Points(const vector<ofVec3f>& positions) : positions(positions) {}
+	Points(const vector<Point>& points);
+
+	inline size_t size() const { return positions.size(); }
+	inline bool empty() const { return positions.empty(); }
+
+	void clear();
+
+	// interleaved copy for code written against Point
+	void getPoints(vector<Point>& points) const;
 
-	void get(Alembic::AbcGeom::OPointsSchema &schema) const;
+	void get(Alembic::AbcGeom::OPointsSchema &schema, Stats *stats = NULL) const;
 	void set(Alembic::AbcGeom::IPointsSchema &schema, float time, const Imath::M44f& transform);
+	void set(Alembic::AbcGeom::IPointsSchema &schema, const Alembic::AbcGeom::ISampleSelector &ss, const Imath::M44f& transform, PointsView *view = NULL, Stats *stats = NULL, unsigned int attributes = ATTRIBUTE_ALL);
 
+	// only matches when the number of points and, if both samples have them, the ids are the same
+	static void readBlend(Alembic::AbcGeom::IPointsSchema &schema, const Alembic::AbcGeom::ISampleSelector &ss, const PointsView &view, SampleBlend &target, Stats *stats = NULL);
+	void blend(const PointsView &view, const SampleBlend &target, float alpha, const Imath::M44f& transform, Stats *stats = NULL);
+
+	void swap(Points &other);
+
+	size_t getMemoryUsage() const;
+	void release();
+
+#ifndef OFX_ALEMBIC_NO_GL
 	void draw();
+#endif
 };
 
+// linear curves in ICurvesSchema's layout: the vertices of all curves back to back in `positions`,
+// curve i spans counts[i] vertices starting at offsets[i]
+
 class ofxAlembic::Curves
 {
 public:
-	vector<ofPolyline> curves;
+	vector<ofVec3f> positions;
+	vector<Alembic::Util::int32_t> counts;
+	vector<Alembic::Util::int32_t> offsets;
 
 	Curves() {}
-	Curves(const vector<ofPolyline> &curves) : curves(curves) {}
+	Curves(const vector<ofPolyline> &curves);
+
+	inline size_t getNumCurves() const { return counts.size(); }
+	inline size_t getNumVertices() const { return positions.size(); }
+
+	inline const ofVec3f* getCurve(size_t i) const { return counts[i] ? &positions[offsets[i]] : NULL; }
+	inline size_t getCurveSize(size_t i) const { return counts[i]; }
+
+	void addCurve(const ofVec3f *vertices, size_t num);
+	void addCurve(const ofPolyline &polyline);
+	void clear();
+
+	// one ofPolyline per curve, for code written against vector<ofPolyline>
+	void getPolylines(vector<ofPolyline> &curves) const;
 
 	void get(Alembic::AbcGeom::OCurvesSchema &schema) const;
+	void get(Alembic::AbcGeom::OCurvesSchema &schema, bool with_topology, Stats *stats = NULL) const;
+
+	Alembic::Util::uint64_t getTopologyDigest() const;
+
 	void set(Alembic::AbcGeom::ICurvesSchema &schema, float time, const Imath::M44f& transform);
+	void set(Alembic::AbcGeom::ICurvesSchema &schema, const Alembic::AbcGeom::ISampleSelector &ss, const Imath::M44f& transform, CurvesView *view = NULL, Stats *stats = NULL);
+
+	// only matches when every curve has the same number of vertices
+	static void readBlend(Alembic::AbcGeom::ICurvesSchema &schema, const Alembic::AbcGeom::ISampleSelector &ss, const CurvesView &view, SampleBlend &target, Stats *stats = NULL);
+	void blend(const CurvesView &view, const SampleBlend &target, float alpha, const Imath::M44f& transform, Stats *stats = NULL);
+
+	void swap(Curves &other);
+
+	size_t getMemoryUsage() const;
+	void release();
 
+#ifndef OFX_ALEMBIC_NO_GL
 	void draw();
+#endif
 };
\ No newline at end of file
@@ -2,7 +2,19 @@
 
 #include "H5public.h"
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define OFX_ALEMBIC_SSE
+#include <xmmintrin.h>
+#endif
+
 static bool inited = false;
+static ofMutex archive_mutex;
+
+static int num_hdf5_archives = 0;
+static ofMutex format_mutex;
+
+static size_t num_allocations = 0;
+static ofMutex allocation_mutex;
 
 void ofxAlembic::init()
 {
@@ -12,24 +24,113 @@ void ofxAlembic::init()
 	H5dont_atexit();
 }
 
-void ofxAlembic::transform(ofMesh &mesh, const ofMatrix4x4 &m)
+ofxAlembic::Format ofxAlembic::detectFormat(const string& path)
 {
-	vector<ofVec3f>& vertices = mesh.getVertices();
+	ifstream ifs(path.c_str(), ios::in | ios::binary);
+	if (!ifs) return FORMAT_UNKNOWN;
+
+	static const char ogawa_magic[] = { 'O', 'g', 'a', 'w', 'a' };
+	static const char hdf5_magic[] = { '\x89', 'H', 'D', 'F', '\r', '\n', '\x1a', '\n' };
+
+	char buf[8];
+
+	if (!ifs.read(buf, sizeof(buf))) return FORMAT_UNKNOWN;
+	if (memcmp(buf, ogawa_magic, sizeof(ogawa_magic)) == 0) return FORMAT_OGAWA;
+
+	// the HDF5 superblock is at 0 or behind a user block of 512, 1024, 2048... bytes
+	for (streamoff offset = 0; ifs; offset = offset ? offset * 2 : 512)
+	{
+		ifs.seekg(offset);
+		if (!ifs.read(buf, sizeof(buf))) break;
+		if (memcmp(buf, hdf5_magic, sizeof(hdf5_magic)) == 0) return FORMAT_HDF5;
+	}
 
-	for (int i = 0; i < vertices.size(); i++)
+	return FORMAT_UNKNOWN;
+}
+
+bool ofxAlembic::isFormatSupported(Format format)
+{
+	switch (format)
 	{
-		vertices[i] = vertices[i] * m;
+		case FORMAT_HDF5:
+			return true;
+
+#ifdef OFX_ALEMBIC_OGAWA
+		case FORMAT_OGAWA:
+			return true;
+#endif
+
+		default:
+			return false;
 	}
+}
+
+const char* ofxAlembic::getFormatName(Format format)
+{
+	switch (format)
+	{
+		case FORMAT_HDF5: return "HDF5";
+		case FORMAT_OGAWA: return "Ogawa";
+		default: return "unknown";
+	}
+}
+
+ofMutex& ofxAlembic::getArchiveMutex()
+{
+	return archive_mutex;
+}
+
+void ofxAlembic::retainArchive(Format format)
+{
+	if (format != FORMAT_HDF5) return;
+
+	ofScopedLock lock(format_mutex);
+	num_hdf5_archives++;
+}
+
+void ofxAlembic::releaseArchive(Format format)
+{
+	if (format != FORMAT_HDF5) return;
+
+	ofScopedLock lock(format_mutex);
+	num_hdf5_archives--;
+}
+
+bool ofxAlembic::isArchiveLockRequired()
+{
+	ofScopedLock lock(format_mutex);
+	return num_hdf5_archives > 0;
+}
+
+size_t ofxAlembic::getNumAllocations()
+{
+	ofScopedLock lock(allocation_mutex);
+	return num_allocations;
+}
+
+void ofxAlembic::resetNumAllocations()
+{
+	ofScopedLock lock(allocation_mutex);
+	num_allocations = 0;
+}
+
+void ofxAlembic::countAllocation()
+{
+	ofScopedLock lock(allocation_mutex);
+	num_allocations++;
+}
+
+void ofxAlembic::transform(ofMesh &mesh, const ofMatrix4x4 &m)
+{
+	vector<ofVec3f>& vertices = mesh.getVertices();
+
+	if (!vertices.empty())
+		transformPoints(m.getPtr(), vertices[0].getPtr(), vertices[0].getPtr(), vertices.size());
 
 	if (mesh.hasNormals())
 	{
 		vector<ofVec3f>& normals = mesh.getNormals();
-
-		for (int i = 0; i < normals.size(); i++)
-		{
-			const ofVec3f& v = normals[i];
-			normals[i] = ofVec4f(v.x, v.y, v.z, 0) * m;
-		}
+		transformDirections(m.getPtr(), normals[0].getPtr(), normals[0].getPtr(), normals.size());
 	}
 }
 
@@ -40,4 +141,234 @@ vector<ofVec3f> toOf(const vector<ofxAlembic::Point>& v)
 		arr[i] = v[i].pos;
 
 	return arr;
-}
\ No newline at end of file
+}
+
+#pragma mark - transform kernels
+
+static bool isIdentity(const float *m)
+{
+	static const float identity[16] = {
+		1, 0, 0, 0,
+		0, 1, 0, 0,
+		0, 0, 1, 0,
+		0, 0, 0, 1
+	};
+	return memcmp(m, identity, sizeof(identity)) == 0;
+}
+
+static bool isAffine(const float *m)
+{
+	return m[3] == 0 && m[7] == 0 && m[11] == 0 && m[15] == 1;
+}
+
+static void copyFloat3(const float *src, float *dst, size_t count, size_t src_stride, size_t dst_stride)
+{
+	if (src == dst && src_stride == dst_stride) return;
+
+	if (src_stride == 3 && dst_stride == 3)
+	{
+		memmove(dst, src, count * 3 * sizeof(float));
+		return;
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		dst[0] = src[0];
+		dst[1] = src[1];
+		dst[2] = src[2];
+		src += src_stride;
+		dst += dst_stride;
+	}
+}
+
+// row vector convention, same as Imath::M44f::multVecMatrix and ofVec3f * ofMatrix4x4
+template <bool translate, bool project>
+static void transformFloat3(const float *m, const float *src, float *dst, size_t count, size_t src_stride, size_t dst_stride)
+{
+#ifdef OFX_ALEMBIC_SSE
+	const __m128 r0 = _mm_loadu_ps(m + 0);
+	const __m128 r1 = _mm_loadu_ps(m + 4);
+	const __m128 r2 = _mm_loadu_ps(m + 8);
+	const __m128 r3 = _mm_loadu_ps(m + 12);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		__m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(src[0]), r0),
+										 _mm_mul_ps(_mm_set1_ps(src[1]), r1)),
+							  _mm_mul_ps(_mm_set1_ps(src[2]), r2));
+
+		if (translate) v = _mm_add_ps(v, r3);
+		if (project) v = _mm_div_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)));
+
+		// write xyz only, src and dst may overlap
+		_mm_storel_pi((__m64*)dst, v);
+		_mm_store_ss(dst + 2, _mm_movehl_ps(v, v));
+
+		src += src_stride;
+		dst += dst_stride;
+	}
+#else
+	for (size_t i = 0; i < count; i++)
+	{
+		const float x = src[0], y = src[1], z = src[2];
+
+		float a = x * m[0] + y * m[4] + z * m[8];
+		float b = x * m[1] + y * m[5] + z * m[9];
+		float c = x * m[2] + y * m[6] + z * m[10];
+
+		if (translate)
+		{
+			a += m[12];
+			b += m[13];
+			c += m[14];
+		}
+
+		if (project)
+		{
+			const float w = x * m[3] + y * m[7] + z * m[11] + m[15];
+			a /= w;
+			b /= w;
+			c /= w;
+		}
+
+		dst[0] = a;
+		dst[1] = b;
+		dst[2] = c;
+
+		src += src_stride;
+		dst += dst_stride;
+	}
+#endif
+}
+
+void ofxAlembic::transformPoints(const float *m, const float *src, float *dst, size_t count, size_t src_stride, size_t dst_stride)
+{
+	if (count == 0) return;
+
+	if (isIdentity(m))
+		copyFloat3(src, dst, count, src_stride, dst_stride);
+	else if (isAffine(m))
+		transformFloat3<true, false>(m, src, dst, count, src_stride, dst_stride);
+	else
+		transformFloat3<true, true>(m, src, dst, count, src_stride, dst_stride);
+}
+
+void ofxAlembic::transformDirections(const float *m, const float *src, float *dst, size_t count, size_t src_stride, size_t dst_stride)
+{
+	if (count == 0) return;
+
+	if (isIdentity(m))
+		copyFloat3(src, dst, count, src_stride, dst_stride);
+	else
+		transformFloat3<false, false>(m, src, dst, count, src_stride, dst_stride);
+}
+
+#pragma mark - normal kernels
+
+void ofxAlembic::computeTriangleNormals(const float *verts, const ofIndexType *indices, float *dst, size_t num_tris)
+{
+	for (size_t t = 0; t < num_tris; t++)
+	{
+		const size_t k = t * 3;
+		const float *p0 = verts + (indices ? indices[k + 0] : k + 0) * 3;
+		const float *p1 = verts + (indices ? indices[k + 1] : k + 1) * 3;
+		const float *p2 = verts + (indices ? indices[k + 2] : k + 2) * 3;
+
+#ifdef OFX_ALEMBIC_SSE
+		const __m128 v0 = _mm_set_ps(0, p0[2], p0[1], p0[0]);
+		const __m128 a = _mm_sub_ps(_mm_set_ps(0, p2[2], p2[1], p2[0]), v0);
+		const __m128 b = _mm_sub_ps(_mm_set_ps(0, p1[2], p1[1], p1[0]), v0);
+
+		// a.yzx * b.zxy - a.zxy * b.yzx
+		const __m128 n = _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2))),
+									_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1))));
+
+		_mm_storel_pi((__m64*)dst, n);
+		_mm_store_ss(dst + 2, _mm_movehl_ps(n, n));
+#else
+		const float ax = p2[0] - p0[0], ay = p2[1] - p0[1], az = p2[2] - p0[2];
+		const float bx = p1[0] - p0[0], by = p1[1] - p0[1], bz = p1[2] - p0[2];
+
+		dst[0] = ay * bz - az * by;
+		dst[1] = az * bx - ax * bz;
+		dst[2] = ax * by - ay * bx;
+#endif
+
+		dst += 3;
+	}
+}
+
+void ofxAlembic::normalizeDirections(float *v, size_t count)
+{
+	for (size_t i = 0; i < count; i++, v += 3)
+	{
+#ifdef OFX_ALEMBIC_SSE
+		const __m128 x = _mm_set_ps(0, v[2], v[1], v[0]);
+		const __m128 sq = _mm_mul_ps(x, x);
+		const __m128 len2 = _mm_add_ss(_mm_add_ss(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(1, 1, 1, 1))), _mm_movehl_ps(sq, sq));
+
+		if (_mm_cvtss_f32(len2) <= 0) continue;
+
+		const __m128 len = _mm_sqrt_ss(len2);
+		const __m128 n = _mm_div_ps(x, _mm_shuffle_ps(len, len, _MM_SHUFFLE(0, 0, 0, 0)));
+
+		_mm_storel_pi((__m64*)v, n);
+		_mm_store_ss(v + 2, _mm_movehl_ps(n, n));
+#else
+		const float len2 = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+
+		if (len2 <= 0) continue;
+
+		const float inv_len = 1.f / sqrtf(len2);
+		v[0] *= inv_len;
+		v[1] *= inv_len;
+		v[2] *= inv_len;
+#endif
+	}
+}
+
+#pragma mark - interpolation kernels
+
+void ofxAlembic::lerpFloats(const float *a, const float *b, float *dst, size_t count, float t)
+{
+	size_t i = 0;
+
+#ifdef OFX_ALEMBIC_SSE
+	const __m128 w = _mm_set1_ps(t);
+
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 x = _mm_loadu_ps(a + i);
+		const __m128 y = _mm_loadu_ps(b + i);
+		_mm_storeu_ps(dst + i, _mm_add_ps(x, _mm_mul_ps(_mm_sub_ps(y, x), w)));
+	}
+#endif
+
+	for (; i < count; i++)
+		dst[i] = a[i] + (b[i] - a[i]) * t;
+}
+
+Imath::M44d ofxAlembic::interpolateMatrix(const Imath::M44d &a, const Imath::M44d &b, double t)
+{
+	Imath::M44d ra = a, rb = b;
+	Imath::V3d sa, sb, ha, hb;
+
+	// degenerate matrices have no rotation to slerp, step at the midpoint
+	if (!Imath::extractAndRemoveScalingAndShear(ra, sa, ha, false)
+		|| !Imath::extractAndRemoveScalingAndShear(rb, sb, hb, false))
+		return t < 0.5 ? a : b;
+
+	const Imath::Quatd q = Imath::slerpShortestArc(Imath::extractQuat(ra), Imath::extractQuat(rb), t);
+
+	Imath::M44d s, h;
+	s.setScale(sa + (sb - sa) * t);
+	h.setShear(ha + (hb - ha) * t);
+
+	// a = scale * shear * rotation * translation
+	Imath::M44d m = s * h * q.toMatrix44();
+
+	for (int i = 0; i < 3; i++)
+		m[3][i] = a[3][i] + (b[3][i] - a[3][i]) * t;
+
+	return m;
+}
@@ -5,16 +5,126 @@
 #include <Alembic/AbcGeom/All.h>
 #include <Alembic/AbcCoreHDF5/All.h>
 
+// define OFX_ALEMBIC_OGAWA when linking against an Alembic build (1.5+) that has AbcCoreOgawa.
+// define OFX_ALEMBIC_NO_GL to leave out every draw() call, see ofxAlembicDraw.cpp
+// define OFX_ALEMBIC_NO_STATS to compile out the phase timers, see ofxAlembicStats.h
+#ifdef OFX_ALEMBIC_OGAWA
+#include <Alembic/AbcCoreOgawa/All.h>
+#endif
+
 #include "ofxAlembicType.h"
 
 namespace ofxAlembic
 {
 	struct Point;
-	
+	class ArchiveLock;
+
+	enum Format
+	{
+		FORMAT_UNKNOWN = 0,
+		FORMAT_HDF5,
+		FORMAT_OGAWA
+	};
+
+#ifdef OFX_ALEMBIC_OGAWA
+	const Format DEFAULT_FORMAT = FORMAT_OGAWA;
+#else
+	const Format DEFAULT_FORMAT = FORMAT_HDF5;
+#endif
+
 	void init();
 	void transform(ofMesh &mesh, const ofMatrix4x4 &m);
+
+	// sniffs the file signature, FORMAT_UNKNOWN if it is neither HDF5 nor Ogawa
+	Format detectFormat(const string& path);
+	bool isFormatSupported(Format format);
+	const char* getFormatName(Format format);
+
+	// HDF5 is not thread safe, while an HDF5 archive is open every archive access goes through this lock.
+	// readers and writers register their archives so Ogawa-only sessions read concurrently.
+	ofMutex& getArchiveMutex();
+	void retainArchive(Format format);
+	void releaseArchive(Format format);
+	bool isArchiveLockRequired();
+
+	// decode buffers keep their capacity across frames, every time one has to grow it is counted.
+	// once warmed up, playback should not move this counter. samples allocated by Alembic itself are not included.
+	size_t getNumAllocations();
+	void resetNumAllocations();
+	void countAllocation();
+
+	template <typename T>
+	inline void resizeBuffer(vector<T> &v, size_t size)
+	{
+		if (size > v.capacity()) countAllocation();
+		v.resize(size);
+	}
+
+	template <typename T>
+	inline void reserveBuffer(vector<T> &v, size_t size)
+	{
+		if (size > v.capacity()) countAllocation();
+		v.reserve(size);
+	}
+
+	// bytes held by a buffer, including unused capacity
+	template <typename T>
+	inline size_t getBufferSize(const vector<T> &v)
+	{
+		return v.capacity() * sizeof(T);
+	}
+
+	// clear() keeps the capacity, this gives it back
+	template <typename T>
+	inline void freeBuffer(vector<T> &v)
+	{
+		vector<T>().swap(v);
+	}
+
+	// batch transform of float3 arrays by a row-major 4x4 matrix (Imath::M44f or ofMatrix4x4 layout).
+	// src and dst may be the same array, strides are in floats.
+	void transformPoints(const float *m, const float *src, float *dst, size_t count, size_t src_stride = 3, size_t dst_stride = 3);
+	void transformDirections(const float *m, const float *src, float *dst, size_t count, size_t src_stride = 3, size_t dst_stride = 3);
+
+	// area weighted normals of clockwise triangles, dst[t] = (v2 - v0) x (v1 - v0) is twice the area long.
+	// `indices` holds three vertex indices per triangle, NULL takes the vertices three by three.
+	void computeTriangleNormals(const float *verts, const ofIndexType *indices, float *dst, size_t num_tris);
+
+	// scales float3s to unit length, zero length vectors are left alone
+	void normalizeDirections(float *v, size_t count);
+
+	// dst = a + (b - a) * t over `count` floats, dst may be a or b
+	void lerpFloats(const float *a, const float *b, float *dst, size_t count, float t);
+
+	// blends two transforms by decomposing them, scale, shear and translation are interpolated
+	// linearly and the rotations slerped along the shortest arc
+	Imath::M44d interpolateMatrix(const Imath::M44d &a, const Imath::M44d &b, double t);
 }
 
+// scoped archive access, locks only while it is required
+
+class ofxAlembic::ArchiveLock
+{
+public:
+
+	ArchiveLock() : locked(isArchiveLockRequired())
+	{
+		if (locked) getArchiveMutex().lock();
+	}
+
+	~ArchiveLock()
+	{
+		if (locked) getArchiveMutex().unlock();
+	}
+
+private:
+
+	bool locked;
+
+	ArchiveLock(const ArchiveLock&);
+	ArchiveLock& operator=(const ArchiveLock&);
+};
+
 inline ofVec3f toOf(const Alembic::AbcGeom::V3f& v)
 {
 	return ofVec3f(v.x, v.y, v.z);
@@ -25,6 +135,16 @@ inline Alembic::AbcGeom::V3f toAbc(const ofVec3f& v)
 	return Alembic::AbcGeom::V3f(v.x, v.y, v.z);
 }
 
+inline ofMatrix4x4 toOf(const Alembic::AbcGeom::M44f& m)
+{
+	return ofMatrix4x4(m.getValue());
+}
+
+inline Alembic::AbcGeom::M44f toAbc(const ofMatrix4x4& m)
+{
+	return Alembic::AbcGeom::M44f((const float (*)[4])m.getPtr());
+}
+
 inline ofVec2f toOf(const Alembic::AbcGeom::V2f& v)
 {
 	return ofVec2f(v.x, v.y);
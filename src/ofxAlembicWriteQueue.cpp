@@ -0,0 +1,194 @@
+#include "ofxAlembicWriteQueue.h"
+
+#include "ofxAlembicWriter.h"
+
+using namespace ofxAlembic;
+
+WriteQueue::WriteQueue() : writer(NULL), head(0), num_pending(0), worker_alive(false), max_pending(0), num_stalls(0), stall_micros(0), num_written(0), num_failed(0)
+{
+}
+
+WriteQueue::~WriteQueue()
+{
+	clear();
+}
+
+void WriteQueue::setup(Writer *writer_, int queue_size)
+{
+	clear();
+
+	if (writer_ == NULL || queue_size < 1) return;
+
+	writer = writer_;
+	jobs.resize(queue_size);
+
+	head = 0;
+	num_pending = 0;
+
+	resetStats();
+
+	lock();
+	worker_alive = true;
+	unlock();
+
+	startThread(true, false);
+}
+
+void WriteQueue::clear()
+{
+	if (isThreadRunning())
+	{
+		drain();
+
+		lock();
+		stopThread();
+		condition.broadcast();
+		unlock();
+
+		waitForThread(false);
+	}
+
+	jobs.clear();
+	writer = NULL;
+}
+
+WriteQueue::Job& WriteQueue::acquire()
+{
+	lock();
+
+	if (num_pending == jobs.size())
+	{
+		unsigned long long t = ofGetElapsedTimeMicros();
+
+		while (num_pending == jobs.size())
+			condition.wait(mutex);
+
+		num_stalls++;
+		stall_micros += ofGetElapsedTimeMicros() - t;
+	}
+
+	// the worker never touches jobs past num_pending
+	Job &job = jobs[(head + num_pending) % jobs.size()];
+
+	unlock();
+
+	return job;
+}
+
+void WriteQueue::submit()
+{
+	lock();
+
+	num_pending++;
+	max_pending = MAX(max_pending, num_pending);
+
+	condition.broadcast();
+	unlock();
+}
+
+void WriteQueue::drain()
+{
+	lock();
+	while (num_pending > 0 && worker_alive)
+		condition.wait(mutex);
+	unlock();
+}
+
+int WriteQueue::getNumPending()
+{
+	ofScopedLock lock(mutex);
+	return num_pending;
+}
+
+int WriteQueue::getMaxPending()
+{
+	ofScopedLock lock(mutex);
+	return max_pending;
+}
+
+int WriteQueue::getNumStalls()
+{
+	ofScopedLock lock(mutex);
+	return num_stalls;
+}
+
+float WriteQueue::getStallTime()
+{
+	ofScopedLock lock(mutex);
+	return stall_micros / 1000000.;
+}
+
+int WriteQueue::getNumWritten()
+{
+	ofScopedLock lock(mutex);
+	return num_written;
+}
+
+int WriteQueue::getNumFailed()
+{
+	ofScopedLock lock(mutex);
+	return num_failed;
+}
+
+void WriteQueue::resetStats()
+{
+	ofScopedLock lock(mutex);
+
+	max_pending = num_pending;
+	num_stalls = 0;
+	stall_micros = 0;
+	num_written = 0;
+	num_failed = 0;
+}
+
+void WriteQueue::threadedFunction()
+{
+	while (true)
+	{
+		lock();
+		while (isThreadRunning() && num_pending == 0)
+			condition.wait(mutex);
+
+		if (num_pending == 0)
+		{
+			unlock();
+			break;
+		}
+
+		Job &job = jobs[head];
+		unlock();
+
+		bool ok = true;
+
+		try
+		{
+			writer->write(job);
+		}
+		catch (std::exception &e)
+		{
+			ofLogError("ofxAlembic::WriteQueue") << job.path << ": " << e.what();
+			ok = false;
+		}
+		catch (...)
+		{
+			ofLogError("ofxAlembic::WriteQueue") << job.path << ": unknown exception";
+			ok = false;
+		}
+
+		lock();
+
+		head = (head + 1) % jobs.size();
+		num_pending--;
+
+		if (ok) num_written++;
+		else num_failed++;
+
+		condition.broadcast();
+		unlock();
+	}
+
+	lock();
+	worker_alive = false;
+	condition.broadcast();
+	unlock();
+}
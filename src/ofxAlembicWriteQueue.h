@@ -0,0 +1,82 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include "Poco/Condition.h"
+
+#include "ofxAlembicType.h"
+
+namespace ofxAlembic
+{
+class Writer;
+class WriteQueue;
+}
+
+// bounded queue of add* calls, converted and written to the archive on a worker thread.
+// jobs are preallocated and recycled, handing off a frame only copies into their buffers.
+
+class ofxAlembic::WriteQueue : public ofThread
+{
+public:
+
+	struct Job
+	{
+		Type type;
+		string path;
+		float time;
+
+		Points points;
+		PolyMesh polymesh;
+		Curves curves;
+	};
+
+	WriteQueue();
+	~WriteQueue();
+
+	void setup(Writer *writer, int queue_size);
+	void clear();
+
+	// returns the next free job, blocks while the queue is full
+	Job& acquire();
+
+	// hands the job returned by acquire() to the worker
+	void submit();
+
+	// blocks until every submitted job is written
+	void drain();
+
+	inline int getQueueSize() const { return jobs.size(); }
+
+	int getNumPending();
+	int getMaxPending();
+
+	// acquire() calls that had to wait for the worker, and the seconds they waited in total
+	int getNumStalls();
+	float getStallTime();
+
+	int getNumWritten();
+	int getNumFailed();
+
+	void resetStats();
+
+protected:
+
+	Writer *writer;
+
+	vector<Job> jobs;
+	int head;
+	int num_pending;
+
+	// cleared by the worker on its way out, drain() stops waiting then
+	bool worker_alive;
+
+	Poco::Condition condition;
+
+	int max_pending;
+	int num_stalls;
+	unsigned long long stall_micros;
+	int num_written;
+	int num_failed;
+
+	void threadedFunction();
+};
@@ -1,18 +1,47 @@
 #include "ofxAlembicWriter.h"
+#include "ofxAlembicTrace.h"
 
 using namespace ofxAlembic;
 using namespace Alembic::AbcGeom;
 
-bool Writer::open(string path, float fps)
+bool Writer::open(string path, float fps, Format format)
 {
 	ofxAlembic::init();
+
+	close();
 	
 	path = ofToDataPath(path);
 
-	archive = OArchive(Alembic::AbcCoreHDF5::WriteArchive(), path);
-	if (!archive.valid()) return false;
+	if (!isFormatSupported(format))
+	{
+		ofLogError("ofxAlembic::Writer") << "unsupported archive format: " << getFormatName(format);
+		return false;
+	}
+
+	retainArchive(format);
+
+	{
+		ArchiveLock lock;
+
+		if (format == FORMAT_HDF5)
+			archive = OArchive(Alembic::AbcCoreHDF5::WriteArchive(), path);
+#ifdef OFX_ALEMBIC_OGAWA
+		else if (format == FORMAT_OGAWA)
+			archive = OArchive(Alembic::AbcCoreOgawa::WriteArchive(), path);
+#endif
+
+		// ignored by Ogawa
+		if (archive.valid())
+			archive.setCompressionHint(1);
+	}
+
+	if (!archive.valid())
+	{
+		releaseArchive(format);
+		return false;
+	}
 
-	archive.setCompressionHint(1);
+	m_format = format;
 
 	inv_fps = 1. / fps;
 	rewind();
@@ -22,53 +51,330 @@ bool Writer::open(string path, float fps)
 
 void Writer::close()
 {
-	map<string, Alembic::AbcGeom::OObject*>::iterator it = object_map.begin();
-	while (it != object_map.end())
+	OFX_ALEMBIC_TRACE("Writer::close", "");
+
+	// everything queued before close still goes into this archive
+	if (m_queue)
+		m_queue->drain();
+
 	{
-		delete it->second;
-		it++;
-	}
+		ArchiveLock lock;
+
+		map<string, Alembic::AbcGeom::OObject*>::iterator it = object_map.begin();
+		while (it != object_map.end())
+		{
+			delete it->second;
+			it++;
+		}
+
+		object_map.clear();
+
+		// keep stable declarations for the next archive, nothing is written yet
+		ofScopedLock topology_lock(topology_mutex);
 
-	object_map.clear();
+		map<string, Topology>::iterator t = topology_map.begin();
+		while (t != topology_map.end())
+		{
+			t->second.written = false;
+			t++;
+		}
 
-	if (archive.valid())
-		archive.reset();
+		if (archive.valid())
+			archive.reset();
+	}
+
+	releaseArchive(m_format);
+	m_format = FORMAT_UNKNOWN;
 }
 
 void Writer::addPoints(const string& path, const Points& points)
+{
+	OFX_ALEMBIC_TRACE("Writer::addPoints", path);
+
+	if (m_queue)
+	{
+		Stats stats;
+
+		{
+			WriteQueue::Job &job = m_queue->acquire();
+
+			OFX_ALEMBIC_TIMER(&stats, PHASE_COPY);
+			job.type = POINTS;
+			job.path = path;
+			job.time = current_time;
+			job.points = points;
+		}
+
+		m_queue->submit();
+		addStats(path, stats);
+		return;
+	}
+
+	writePoints(path, current_time, points);
+}
+
+void Writer::addPolyMesh(const string& path, const PolyMesh& polymesh)
+{
+	OFX_ALEMBIC_TRACE("Writer::addPolyMesh", path);
+
+	if (m_queue)
+	{
+		Stats stats;
+
+		{
+			WriteQueue::Job &job = m_queue->acquire();
+
+			OFX_ALEMBIC_TIMER(&stats, PHASE_COPY);
+			job.type = POLYMESH;
+			job.path = path;
+			job.time = current_time;
+			job.polymesh = polymesh;
+		}
+
+		m_queue->submit();
+		addStats(path, stats);
+		return;
+	}
+
+	writePolyMesh(path, current_time, polymesh);
+}
+
+void Writer::addCurves(const string& path, const Curves& curves)
+{
+	OFX_ALEMBIC_TRACE("Writer::addCurves", path);
+
+	if (m_queue)
+	{
+		Stats stats;
+
+		{
+			WriteQueue::Job &job = m_queue->acquire();
+
+			OFX_ALEMBIC_TIMER(&stats, PHASE_COPY);
+			job.type = CURVES;
+			job.path = path;
+			job.time = current_time;
+			job.curves = curves;
+		}
+
+		m_queue->submit();
+		addStats(path, stats);
+		return;
+	}
+
+	writeCurves(path, current_time, curves);
+}
+
+void Writer::write(const WriteQueue::Job& job)
+{
+	switch (job.type)
+	{
+		case POINTS:
+			writePoints(job.path, job.time, job.points);
+			break;
+
+		case POLYMESH:
+			writePolyMesh(job.path, job.time, job.polymesh);
+			break;
+
+		case CURVES:
+			writeCurves(job.path, job.time, job.curves);
+			break;
+
+		default:
+			break;
+	}
+}
+
+void Writer::writePoints(const string& path, float time, const Points& points)
 {
 	typedef OPoints Type;
 	typedef Type::schema_type Schema;
 	typedef Schema::Sample Sample;
 
-	Type &object = getObject<Type>(path);
-	Schema &schema = object.getSchema();
+	OFX_ALEMBIC_TRACE("Writer::writePoints", path);
+
+	Stats stats;
 
-	points.get(schema);
+	{
+		ArchiveLock lock;
+
+		Type &object = getObject<Type>(path, time);
+		Schema &schema = object.getSchema();
+
+		points.get(schema, &stats);
+	}
+
+	addStats(path, stats);
 }
 
-void Writer::addPolyMesh(const string& path, const PolyMesh& polymesh)
+void Writer::writePolyMesh(const string& path, float time, const PolyMesh& polymesh)
 {
 	typedef OPolyMesh Type;
 	typedef Type::schema_type Schema;
 	typedef Schema::Sample Sample;
 
-	Type &object = getObject<Type>(path);
-	Schema &schema = object.getSchema();
+	OFX_ALEMBIC_TRACE("Writer::writePolyMesh", path);
+
+	Stats stats;
+
+	// hashing the face layout needs no archive access, keep it out of the lock
+	bool with_topology;
+	Alembic::Util::uint64_t digest = 0;
 
-	polymesh.get(schema);
+	{
+		OFX_ALEMBIC_TIMER(&stats, PHASE_DIGEST);
+		with_topology = needsTopology(path, polymesh, digest);
+	}
+
+	{
+		ArchiveLock lock;
+
+		Type &object = getObject<Type>(path, time);
+		Schema &schema = object.getSchema();
+
+		polymesh.get(schema, with_topology, &stats);
+	}
+
+	// a throwing get() leaves the layout unwritten, the next frame sends it again
+	if (with_topology)
+		markTopologyWritten(path, digest);
+
+	addStats(path, stats);
 }
 
-void Writer::addCurves(const string& path, const Curves& curves)
+void Writer::writeCurves(const string& path, float time, const Curves& curves)
 {
 	typedef OCurves Type;
 	typedef Type::schema_type Schema;
 	typedef Schema::Sample Sample;
 
-	Type &object = getObject<Type>(path);
-	Schema &schema = object.getSchema();
+	OFX_ALEMBIC_TRACE("Writer::writeCurves", path);
+
+	Stats stats;
+
+	// hashing the face layout needs no archive access, keep it out of the lock
+	bool with_topology;
+	Alembic::Util::uint64_t digest = 0;
+
+	{
+		OFX_ALEMBIC_TIMER(&stats, PHASE_DIGEST);
+		with_topology = needsTopology(path, curves, digest);
+	}
+
+	{
+		ArchiveLock lock;
+
+		Type &object = getObject<Type>(path, time);
+		Schema &schema = object.getSchema();
+
+		curves.get(schema, with_topology, &stats);
+	}
+
+	// a throwing get() leaves the layout unwritten, the next frame sends it again
+	if (with_topology)
+		markTopologyWritten(path, digest);
+
+	addStats(path, stats);
+}
+
+// topology
+
+void Writer::setTopologyStable(const string& path, bool stable)
+{
+	ofScopedLock lock(topology_mutex);
+	topology_map[path].stable = stable;
+}
+
+template <typename T>
+bool Writer::needsTopology(const string& path, const T& geom, Alembic::Util::uint64_t& digest)
+{
+	{
+		ofScopedLock lock(topology_mutex);
+
+		Topology &topology = topology_map[path];
+
+		if (topology.stable && topology.written)
+			return false;
+	}
+
+	// the schema dedups equal samples on its own, the digest saves building and hashing the arrays.
+	// hashed without any lock, only one thread writes a given path
+	digest = geom.getTopologyDigest();
 
-	curves.get(schema);
+	ofScopedLock lock(topology_mutex);
+
+	const Topology &topology = topology_map[path];
+	return !(topology.written && topology.digest == digest);
+}
+
+void Writer::markTopologyWritten(const string& path, Alembic::Util::uint64_t digest)
+{
+	ofScopedLock lock(topology_mutex);
+
+	Topology &topology = topology_map[path];
+	topology.written = true;
+	topology.digest = digest;
+}
+
+// stats
+
+void Writer::addStats(const string& path, const Stats& stats)
+{
+#ifndef OFX_ALEMBIC_NO_STATS
+	ofScopedLock lock(stats_mutex);
+
+	m_stats.add(stats);
+	m_totalStats.add(stats);
+	m_objectStats[path].add(stats);
+#endif
+}
+
+Stats Writer::getStats()
+{
+	ofScopedLock lock(stats_mutex);
+	return m_stats;
+}
+
+Stats Writer::getTotalStats()
+{
+	ofScopedLock lock(stats_mutex);
+	return m_totalStats;
+}
+
+Stats Writer::getObjectStats(const string& path)
+{
+	ofScopedLock lock(stats_mutex);
+
+	map<string, Stats>::iterator it = m_objectStats.find(path);
+	if (it == m_objectStats.end()) return Stats();
+
+	return it->second;
+}
+
+void Writer::resetStats()
+{
+	ofScopedLock lock(stats_mutex);
+
+	m_stats.clear();
+	m_totalStats.clear();
+	m_objectStats.clear();
+}
+
+// async
+
+void Writer::enableAsync(int queue_size)
+{
+	disableAsync();
+
+	m_queue = ofPtr<WriteQueue>(new WriteQueue);
+	m_queue->setup(this, queue_size);
+}
+
+void Writer::disableAsync()
+{
+	if (m_queue)
+		m_queue.reset();
 }
 
 // time
@@ -76,6 +382,9 @@ void Writer::addCurves(const string& path, const Curves& curves)
 void Writer::setTime(float time)
 {
 	current_time = time;
+
+	ofScopedLock lock(stats_mutex);
+	m_stats.clear();
 }
 
 void Writer::flashFrame()
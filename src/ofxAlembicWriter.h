@@ -3,6 +3,8 @@
 #include "ofMain.h"
 
 #include "ofxAlembicType.h"
+#include "ofxAlembicUtil.h"
+#include "ofxAlembicWriteQueue.h"
 
 #include <Alembic/AbcGeom/All.h>
 #include <Alembic/AbcCoreHDF5/All.h>
@@ -15,17 +17,35 @@ class Writer;
 
 class ofxAlembic::Writer
 {
+	friend class WriteQueue;
+
 public:
 
+	Writer() : m_format(FORMAT_UNKNOWN) {}
 	~Writer() { close(); }
 
-	bool open(string path, float fps = 30);
+	// Ogawa when available, HDF5 otherwise
+	bool open(string path, float fps = 30, Format format = DEFAULT_FORMAT);
 	void close();
 
+	inline Format getFormat() const { return m_format; }
+
 	void addPoints(const string& path, const Points& points);
 	void addPolyMesh(const string& path, const PolyMesh& polymesh);
 	void addCurves(const string& path, const Curves& curves);
 
+	// promise that the face layout (or curve vertex counts) of `path` never changes, after the first
+	// sample only positions are written without comparing topology digests
+	void setTopologyStable(const string& path, bool stable = true);
+
+	// add* only copy the data into a queue of `queue_size` frames, conversion and I/O run on a worker thread.
+	// add* blocks while the queue is full, close() writes everything that is still queued.
+	void enableAsync(int queue_size = 8);
+	void disableAsync();
+
+	inline bool isAsync() const { return m_queue.get() != NULL; }
+	inline WriteQueue* getWriteQueue() { return m_queue.get(); }
+
 	void setTime(float time);
 	float getTime() const { return current_time; }
 
@@ -33,16 +53,59 @@ public:
 
 	void flashFrame();
 
+	// conversion and schema.set time (and the async queue handoff) since the last setTime() or flashFrame(),
+	// everything since open() or resetStats(), and the same per object path. async writes are counted
+	// in the frame during which the worker finished them.
+	Stats getStats();
+	Stats getTotalStats();
+	Stats getObjectStats(const string& path);
+	void resetStats();
+
 protected:
 
 	map<string, Alembic::AbcGeom::OObject*> object_map;
 	Alembic::AbcGeom::OArchive archive;
+	Format m_format;
 
 	float inv_fps;
 	float current_time;
 
+	ofPtr<WriteQueue> m_queue;
+
+	// last face layout written per object
+	struct Topology
+	{
+		bool stable;
+		bool written;
+		Alembic::Util::uint64_t digest;
+
+		Topology() : stable(false), written(false), digest(0) {}
+	};
+
+	map<string, Topology> topology_map;
+	ofMutex topology_mutex;
+
+	Stats m_stats;
+	Stats m_totalStats;
+	map<string, Stats> m_objectStats;
+	ofMutex stats_mutex;
+
+	void addStats(const string& path, const Stats& stats);
+
+	// whether the next sample of `path` needs its face layout, `digest` is only committed
+	// with markTopologyWritten() once the sample is in the schema
+	template <typename T>
+	bool needsTopology(const string& path, const T& geom, Alembic::Util::uint64_t& digest);
+	void markTopologyWritten(const string& path, Alembic::Util::uint64_t digest);
+
+	void write(const WriteQueue::Job& job);
+
+	void writePoints(const string& path, float time, const Points& points);
+	void writePolyMesh(const string& path, float time, const PolyMesh& polymesh);
+	void writeCurves(const string& path, float time, const Curves& curves);
+
 	template <typename T>
-	T& getObject(const string& path)
+	T& getObject(const string& path, float time)
 	{
 		using namespace Alembic::AbcGeom;
 
@@ -62,7 +125,7 @@ protected:
 
 		if (it == object_map.end())
 		{
-			TimeSampling Ts(inv_fps, current_time);
+			TimeSampling Ts(inv_fps, time);
 			Alembic::Util::uint32_t tsidx = archive.addTimeSampling(Ts);
 
 			T *t = new T(archive.getTop(), p);